@@ -0,0 +1,512 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace BM {
+
+// Anything async_apply() can resume coroutines on
+template<typename E>
+concept Executor = requires(E& e, std::function<void()> task) {
+    e.execute(std::move(task));
+};
+
+// Minimal fixed-size thread pool executor; the destructor runs what is still
+// queued and joins the workers
+class thread_pool {
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock l(m);
+                cv.wait(l, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit thread_pool(unsigned threads = std::max(1u, std::thread::hardware_concurrency())) {
+        workers.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard l(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // Notifies under the lock: tasks may come from threads outside the pool
+    // (delayed retries), and the pool may be gone as soon as they run
+    void execute(std::function<void()> task) {
+        std::lock_guard l(m);
+        tasks.push_back(std::move(task));
+        cv.notify_one();
+    }
+};
+
+// Executor used by async_apply() when none is given
+inline thread_pool& default_executor() {
+    static thread_pool pool;
+    return pool;
+}
+
+// Someone waiting for an async_mutex to be released
+struct unlock_waiter {
+    void (*wake)(unlock_waiter*);
+    unlock_waiter* next = nullptr;
+};
+
+// Mutex wrapper that tells async_apply() when it gets released, so suspended
+// coroutines retry exactly then instead of polling. Otherwise it behaves as
+// Mutex, including in plain apply().
+//
+// Whoever takes the mutex next may destroy the value it guards, so nothing
+// of *this is touched once mut is released: the release is announced and
+// the waiters are taken off the list while still holding it, and only that
+// list is woken afterwards.
+template<Lockable Mutex = std::mutex>
+class async_mutex {
+    Mutex mut;
+    // Only ever bumped by a holder: to odd when it releases the mutex, back
+    // to even when it is taken again. Odd = released, not taken since - a
+    // failed try_lock() may be the holder that is just announcing it.
+    std::atomic<unsigned> generation{0};
+    std::atomic<unsigned> waiting{0};
+    std::mutex waiters_mutex;
+    unlock_waiter* waiters = nullptr;
+
+    void taken() {
+        unsigned g = generation.load(std::memory_order_relaxed);
+        while ((g & 1) && !generation.compare_exchange_weak(g, g + 1, std::memory_order_seq_cst)) {
+        }
+    }
+
+    unlock_waiter* releasing() {
+        unsigned g = generation.load(std::memory_order_relaxed);
+        while (!(g & 1) && !generation.compare_exchange_weak(g, g + 1, std::memory_order_seq_cst)) {
+        }
+        if (waiting.load(std::memory_order_seq_cst) == 0) {
+            return nullptr;
+        }
+        std::lock_guard l(waiters_mutex);
+        waiting.store(0, std::memory_order_relaxed);
+        return std::exchange(waiters, nullptr);
+    }
+
+    static void wake(unlock_waiter* woken) {
+        while (woken) {
+            auto* w = std::exchange(woken, woken->next);
+            w->wake(w);
+        }
+    }
+
+public:
+    // Lockable
+    void lock() {
+        mut.lock();
+        taken();
+    }
+
+    bool try_lock() {
+        if (!mut.try_lock()) {
+            return false;
+        }
+        taken();
+        return true;
+    }
+
+    void unlock() {
+        auto* woken = releasing();
+        mut.unlock();
+        wake(woken);
+    }
+
+    // SharedLockable, when Mutex is
+    void lock_shared() requires SharedLockable<Mutex> {
+        mut.lock_shared();
+        taken();
+    }
+
+    bool try_lock_shared() requires SharedLockable<Mutex> {
+        if (!mut.try_lock_shared()) {
+            return false;
+        }
+        taken();
+        return true;
+    }
+
+    void unlock_shared() requires SharedLockable<Mutex> {
+        auto* woken = releasing();
+        mut.unlock_shared();
+        wake(woken);
+    }
+
+    // Read before trying to lock, pass to wait_for_unlock() if that failed
+    unsigned unlock_generation() const {
+        return generation.load(std::memory_order_seq_cst);
+    }
+
+    // Calls w.wake(&w) once, as soon as the mutex has been released after
+    // unlock_generation() returned `seen` - right away if it already has been.
+    // Returns false (and never calls w.wake) if `seen` was read while the
+    // mutex was being released: there may be no release left to wait for,
+    // try again instead.
+    bool wait_for_unlock(unlock_waiter& w, unsigned seen) {
+        if (seen & 1) {
+            return false;
+        }
+        {
+            std::lock_guard l(waiters_mutex);
+            w.next = waiters;
+            waiters = &w;
+            waiting.store(1, std::memory_order_seq_cst);
+            if (generation.load(std::memory_order_seq_cst) == seen) {
+                return true;
+            }
+            // released meanwhile - unless that release already took w, wake it here
+            auto** p = &waiters;
+            while (*p && *p != &w) {
+                p = &(*p)->next;
+            }
+            if (!*p) {
+                return true;
+            }
+            *p = w.next;
+        }
+        w.wake(&w);
+        return true;
+    }
+};
+
+namespace detail {
+    // Runs tasks after a delay, on a thread of its own (started on first use);
+    // the destructor runs what is still pending right away. The tasks hand
+    // retries to an executor, so the default one is built first and outlives
+    // this (statics go in reverse order); tasks scheduled while exiting, once
+    // this is gone, run right away.
+    class delayed_tasks {
+        std::mutex m;
+        std::condition_variable cv;
+        std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> tasks;
+        bool stopping = false;
+        std::thread worker;
+
+        static inline std::atomic<bool> destroyed{false};
+
+        void work() {
+            std::unique_lock l(m);
+            while (!stopping) {
+                if (tasks.empty()) {
+                    cv.wait(l);
+                } else if (auto due = tasks.begin()->first; std::chrono::steady_clock::now() < due) {
+                    cv.wait_until(l, due);
+                } else {
+                    auto task = std::move(tasks.begin()->second);
+                    tasks.erase(tasks.begin());
+                    l.unlock();
+                    task();
+                    l.lock();
+                }
+            }
+        }
+
+        delayed_tasks() {
+            default_executor();
+            worker = std::thread([this] { work(); });
+        }
+
+        ~delayed_tasks() {
+            {
+                std::lock_guard l(m);
+                stopping = true;
+            }
+            cv.notify_one();
+            worker.join();
+            destroyed.store(true);
+            for (auto& [due, task] : tasks) {
+                task();
+            }
+        }
+
+        static delayed_tasks& instance() {
+            static delayed_tasks timer;
+            return timer;
+        }
+
+    public:
+        delayed_tasks(const delayed_tasks&) = delete;
+        delayed_tasks& operator=(const delayed_tasks&) = delete;
+
+        static void after(std::chrono::steady_clock::duration delay, std::function<void()> task) {
+            if (destroyed.load()) {
+                task();
+                return;
+            }
+            auto& timer = instance();
+            {
+                std::lock_guard l(timer.m);
+                timer.tasks.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+            }
+            timer.cv.notify_one();
+        }
+    };
+
+    template<typename M>
+    concept UnlockObservable = requires(M& m, unlock_waiter& w, unsigned seen) {
+        { m.unlock_generation() } -> std::same_as<unsigned>;
+        { m.wait_for_unlock(w, seen) } -> std::same_as<bool>;
+    };
+
+    // Mutex of a value if async_apply() can wait for it to be released
+    template<typename SV>
+    auto* observable_mutex(SV& sv) {
+        using T = std::remove_cvref_t<SV>;
+        if constexpr (is_synchronized_value_v<T> || is_shared_synchronized_value_v<T>) {
+            auto& m = get_mutex_ref(sv);
+            if constexpr (UnlockObservable<std::remove_reference_t<decltype(m)>>) {
+                return &m;
+            } else {
+                return static_cast<void*>(nullptr);
+            }
+        } else {
+            return static_cast<void*>(nullptr);
+        }
+    }
+
+    template<typename F, typename Adapters>
+    struct adapters_result;
+
+    template<typename F, typename... Adapters>
+    struct adapters_result<F, std::tuple<Adapters...>> {
+        using type = decltype(invoke_and_commit(std::declval<F>(), std::declval<Adapters&>()...));
+    };
+
+    template<Executor Ex, typename F, typename... SVs>
+    class async_apply_awaitable {
+        using adapters_type = std::tuple<decltype(make_lockable_adapter(std::declval<SVs>()))...>;
+        using result_type = typename adapters_result<F, adapters_type>::type;
+
+        struct entry {
+            lock_order_key key;
+            void* lockable;
+            bool (*try_lock)(void*);
+            void (*unlock)(void*);
+            void* observable;                               // async_mutex or nullptr
+            unsigned (*generation)(void*);
+            bool (*wait_for_unlock)(void*, unlock_waiter&, unsigned);
+        };
+
+        Ex& ex;
+        F f;
+        adapters_type adapters;
+        std::array<entry, sizeof...(SVs)> order;
+        std::conditional_t<std::is_void_v<result_type>, bool, std::optional<result_type>> result{};
+        std::exception_ptr error;
+        std::coroutine_handle<> waiting;
+
+        struct retrying_waiter : unlock_waiter {
+            async_apply_awaitable* self;
+        } waiter{{[](unlock_waiter* w) {
+            auto* self = static_cast<retrying_waiter*>(w)->self;
+            self->ex.execute([self] { self->retry(); });
+        }}, this};
+
+        template<typename Adapter, typename SV>
+        static entry make_entry(Adapter& a, SV& sv) {
+            entry e{
+                lock_order_of(a),
+                &a,
+                [](void* p) { return static_cast<Adapter*>(p)->try_lock(); },
+                [](void* p) { static_cast<Adapter*>(p)->unlock(); },
+                observable_mutex(sv),
+                nullptr,
+                nullptr,
+            };
+            using M = std::remove_pointer_t<decltype(observable_mutex(sv))>;
+            if constexpr (!std::is_void_v<M>) {
+                e.generation = [](void* m) { return static_cast<M*>(m)->unlock_generation(); };
+                e.wait_for_unlock = [](void* m, unlock_waiter& w, unsigned seen) {
+                    return static_cast<M*>(m)->wait_for_unlock(w, seen);
+                };
+            }
+            return e;
+        }
+
+        // All locks or none, in lock_order_key order; runs f if all were taken.
+        // Returns the entry that was busy, or nullptr once f has run.
+        const entry* attempt(unsigned& seen) {
+            defer_scope deferred;   // runs after the unlocks below
+            std::optional<apply_probe> probe;   // the attempt that runs f
+            std::size_t locked = 0;
+            for (; locked < order.size(); ++locked) {
+                auto& e = order[locked];
+                seen = e.observable ? e.generation(e.observable) : 0;
+                if (!e.try_lock(e.lockable)) {
+                    break;
+                }
+            }
+            if (locked == order.size()) {
+                probe.emplace(lock_order_of(std::get<0>(adapters)).address, sizeof...(SVs));
+                try {
+                    std::apply([&](auto&... a) {
+                        ([&] {
+                            if constexpr (requires { a.on_apply(sizeof...(SVs)); }) {
+                                a.on_apply(sizeof...(SVs));
+                            }
+                        }(), ...);
+                        if constexpr (std::is_void_v<result_type>) {
+                            invoke_and_commit(std::move(f), a...);
+                            result = true;
+                        } else {
+                            result.emplace(invoke_and_commit(std::move(f), a...));
+                        }
+                    }, adapters);
+                } catch (...) {
+                    error = std::current_exception();
+                    deferred.discard();
+                }
+            }
+            const entry* busy = locked == order.size() ? nullptr : &order[locked];
+            while (locked-- > 0) {
+                order[locked].unlock(order[locked].lockable);
+            }
+            return busy;
+        }
+
+        // Between retries on a mutex that cannot tell when it is released
+        static constexpr std::chrono::microseconds min_backoff{16};
+        static constexpr std::chrono::microseconds max_backoff{1000};
+        std::chrono::microseconds backoff{0};
+
+        // Suspended: wait for the busy mutex to be released, then try again
+        // on the executor. A mutex that cannot tell us (not an async_mutex)
+        // is retried right away once, then after exponentially growing
+        // delays - a value held for long must not turn into a pool thread
+        // spinning on it. The same goes for an async_mutex found in the
+        // middle of a release.
+        void wait(const entry& busy, unsigned seen) {
+            if (busy.observable && busy.wait_for_unlock(busy.observable, waiter, seen)) {
+                return;
+            }
+            if (backoff == backoff.zero()) {
+                backoff = min_backoff;
+                ex.execute([this] { retry(); });
+            } else {
+                auto delay = std::exchange(backoff, std::min(backoff * 2, max_backoff));
+                delayed_tasks::after(delay, [this] { ex.execute([this] { retry(); }); });
+            }
+        }
+
+        void retry() {
+            unsigned seen;
+            if (const entry* busy = attempt(seen)) {
+                wait(*busy, seen);
+            } else {
+                waiting.resume();
+            }
+        }
+
+    public:
+        async_apply_awaitable(Ex& ex, F f, SVs&&... svs)
+            : ex(ex), f(std::move(f)), adapters{make_lockable_adapter(std::forward<SVs>(svs))...} {
+            std::apply([&](auto&... a) { order = {make_entry(a, svs)...}; }, adapters);
+            std::sort(order.begin(), order.end(), [](const entry& a, const entry& b) { return a.key < b.key; });
+        }
+
+        async_apply_awaitable(const async_apply_awaitable&) = delete;
+        async_apply_awaitable& operator=(const async_apply_awaitable&) = delete;
+
+        bool await_ready() {
+            unsigned seen;
+            busy_ = attempt(seen);
+            seen_ = seen;
+            return busy_ == nullptr;
+        }
+
+        // Nothing of *this may be touched after wait(): the coroutine can be
+        // resumed (and the awaitable destroyed) on another thread right away
+        void await_suspend(std::coroutine_handle<> h) {
+            waiting = h;
+            wait(*busy_, seen_);
+        }
+
+        auto await_resume() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if constexpr (!std::is_void_v<result_type>) {
+                return std::move(*result);
+            }
+        }
+
+    private:
+        const entry* busy_ = nullptr;
+        unsigned seen_ = 0;
+    };
+} // namespace detail
+
+// Awaitable apply() for coroutines: co_await async_apply(f, a, b).
+//
+// If all values can be locked right away, f runs immediately; otherwise the
+// coroutine is suspended - the thread is free to run other coroutines - and
+// tries again on the executor when the busy value is released (async_mutex)
+// or, for other mutexes, after a back-off growing from 16 us to 1 ms. Locks
+// are only ever tried, all of them or none, in ordered_lock_policy order: a
+// suspended coroutine holds nothing, so no deadlock with other apply()s is
+// possible.
+//
+// f runs on whichever thread took the locks; co_await yields f's result.
+// The values must outlive the co_await.
+template<Executor Ex, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto async_apply(Ex& ex, F f, SV0&& sv0, SVs&&... svs)
+{
+    return detail::async_apply_awaitable<Ex, F, SV0, SVs...>(ex, std::move(f), std::forward<SV0>(sv0),
+                                                            std::forward<SVs>(svs)...);
+}
+
+template<typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto async_apply(F f, SV0&& sv0, SVs&&... svs)
+{
+    return async_apply(default_executor(), std::move(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+} // namespace BM
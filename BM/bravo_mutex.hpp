@@ -0,0 +1,268 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+
+// Let readers skip the memory fence on the fast path and make writers pay for
+// it with membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) instead - an IPI to every
+// CPU running this process, once per revocation of the reader fast path
+#ifndef SV_USE_MEMBARRIER
+#define SV_USE_MEMBARRIER 0
+#endif
+
+#if SV_USE_MEMBARRIER
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace BM {
+
+namespace detail {
+    // Reader side / writer side of a store-fence-load handshake (Dekker style)
+    class asymmetric_fence {
+#if SV_USE_MEMBARRIER
+        static bool expedited() {
+            static const bool registered =
+                syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+            return registered;
+        }
+#else
+        static constexpr bool expedited() { return false; }
+#endif
+
+    public:
+        static void light() {
+            if (expedited()) {
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            } else {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        static void heavy() {
+#if SV_USE_MEMBARRIER
+            if (expedited()) {
+                syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+                return;
+            }
+#endif
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    };
+
+    // Visible readers table shared by all bravo_mutexes: one cache line of
+    // slots per thread, a reader publishes the lock it holds in the slot the
+    // lock's address hashes to. Only the owning thread writes its row, so
+    // readers need no read-modify-write; writers scan one slot per row.
+    class visible_readers {
+    public:
+        static constexpr std::size_t row_slots = cache_line_size / sizeof(void*);
+
+        struct alignas(cache_line_size) row {
+            std::array<std::atomic<const void*>, row_slots> slots{};
+            std::atomic<bool> in_use{true};
+            row* next = nullptr;
+        };
+
+    private:
+        std::atomic<row*> rows{nullptr};
+
+        // Claims a row left behind by an exited thread, or adds a new one
+        row* acquire_row() {
+            for (auto* r = rows.load(std::memory_order_acquire); r; r = r->next) {
+                bool free = false;
+                if (r->in_use.compare_exchange_strong(free, true)) {
+                    return r;
+                }
+            }
+            auto* r = new row;
+            r->next = rows.load(std::memory_order_relaxed);
+            while (!rows.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+            return r;
+        }
+
+    public:
+        static visible_readers& instance() {
+            static visible_readers table;
+            return table;
+        }
+
+        ~visible_readers() {
+            for (auto* r = rows.load(); r;) {
+                delete std::exchange(r, r->next);
+            }
+        }
+
+        static std::size_t slot_of(const void* lock) {
+            auto a = reinterpret_cast<std::uintptr_t>(lock);
+            return ((a >> 6) ^ (a >> 12)) % row_slots;
+        }
+
+        row& local_row() {
+            struct handle {
+                row* r;
+                explicit handle(visible_readers& t) : r(t.acquire_row()) {}
+                ~handle() { r->in_use.store(false, std::memory_order_release); }
+            };
+            thread_local handle h(*this);
+            return *h.r;
+        }
+
+        // Calls f(slot) for lock's slot in every row
+        template<typename F>
+        void for_each_slot(const void* lock, F&& f) {
+            auto i = slot_of(lock);
+            for (auto* r = rows.load(std::memory_order_acquire); r; r = r->next) {
+                f(r->slots[i]);
+            }
+        }
+    };
+} // namespace detail
+
+// BRAVO (Biased Locking for Reader-Writer Locks, Dice & Kogan) on top of any
+// SharedLockable mutex.
+//
+// While the lock is reader-biased, lock_shared() only publishes the lock in
+// the calling thread's own slot of a global visible-readers table - no write
+// to a cache line shared with other readers. A writer revokes the bias, waits
+// for the published readers to leave and then holds the underlying mutex, as
+// do readers that find the bias revoked. The bias is restored by a reader
+// once a multiple of the last revocation's cost has passed, so write-heavy
+// phases do not keep paying for revocations.
+//
+// Drop-in for std::shared_mutex in synchronized_value / share().
+template<SharedLockable Mutex = std::shared_mutex>
+class bravo_mutex {
+    using clock = std::chrono::steady_clock;
+    static constexpr int inhibit_multiplier = 9;   // as in the BRAVO paper
+
+    std::atomic<bool> rbias{true};
+    std::atomic<clock::rep> inhibit_until{0};
+    Mutex underlying;
+
+    std::atomic<const void*>& local_slot() const {
+        return detail::visible_readers::instance().local_row().slots[detail::visible_readers::slot_of(this)];
+    }
+
+    bool try_fast_read() {
+        if (!rbias.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        auto& slot = local_slot();
+        if (slot.load(std::memory_order_relaxed) != nullptr) {
+            return false;   // another lock hashed to the same slot
+        }
+        slot.store(this, std::memory_order_relaxed);
+        detail::asymmetric_fence::light();
+        if (rbias.load(std::memory_order_acquire)) {
+            return true;
+        }
+        slot.store(nullptr, std::memory_order_relaxed);
+        return false;
+    }
+
+    // With underlying held shared
+    void maybe_rebias() {
+        if (!rbias.load(std::memory_order_relaxed) &&
+            clock::now().time_since_epoch().count() >= inhibit_until.load(std::memory_order_relaxed)) {
+            rbias.store(true, std::memory_order_release);
+        }
+    }
+
+    // With underlying held exclusively: false if wait is false and readers are
+    // still inside (the bias is then left revoked, see try_lock())
+    bool revoke(bool wait) {
+        if (!rbias.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        auto start = clock::now();
+        rbias.store(false, std::memory_order_relaxed);
+        detail::asymmetric_fence::heavy();
+        bool drained = true;
+        detail::visible_readers::instance().for_each_slot(this, [&](std::atomic<const void*>& slot) {
+            while (drained && slot.load(std::memory_order_acquire) == this) {
+                if (!wait) {
+                    drained = false;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        auto now = clock::now();
+        inhibit_until.store((now + (now - start) * inhibit_multiplier).time_since_epoch().count(),
+                            std::memory_order_relaxed);
+        return drained;
+    }
+
+public:
+    bravo_mutex() = default;
+    bravo_mutex(const bravo_mutex&) = delete;
+    bravo_mutex& operator=(const bravo_mutex&) = delete;
+
+    // Lockable - writers
+    void lock() {
+        underlying.lock();
+        revoke(true);
+    }
+
+    // Never waits for readers: a fast reader may be waiting for a lock the
+    // caller holds (std::lock() relies on try_lock() not blocking)
+    bool try_lock() {
+        if (!underlying.try_lock()) {
+            return false;
+        }
+        if (!revoke(false)) {
+            // readers still inside: hand the fast path back to them, the next
+            // writer has to find the bias set or it would not wait for them
+            rbias.store(true, std::memory_order_relaxed);
+            underlying.unlock();
+            return false;
+        }
+        return true;
+    }
+
+    void unlock() {
+        underlying.unlock();
+    }
+
+    // SharedLockable - readers
+    void lock_shared() {
+        if (try_fast_read()) {
+            return;
+        }
+        underlying.lock_shared();
+        maybe_rebias();
+    }
+
+    bool try_lock_shared() {
+        if (try_fast_read()) {
+            return true;
+        }
+        if (!underlying.try_lock_shared()) {
+            return false;
+        }
+        maybe_rebias();
+        return true;
+    }
+
+    // The calling thread's slot holds this lock only if it read-locked it on
+    // the fast path (rows are per thread)
+    void unlock_shared() {
+        auto& slot = local_slot();
+        if (slot.load(std::memory_order_relaxed) == this) {
+            slot.store(nullptr, std::memory_order_release);
+        } else {
+            underlying.unlock_shared();
+        }
+    }
+};
+
+} // namespace BM
@@ -0,0 +1,316 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace BM {
+
+namespace detail {
+    // Smallest always lock-free unsigned integer with room for a T plus one
+    // byte of lock state, void if there is none
+    template<typename T>
+    constexpr auto cas_word() {
+        if constexpr (sizeof(T) < sizeof(std::uint16_t) && std::atomic<std::uint16_t>::is_always_lock_free) {
+            return std::uint16_t{};
+        } else if constexpr (sizeof(T) < sizeof(std::uint32_t) && std::atomic<std::uint32_t>::is_always_lock_free) {
+            return std::uint32_t{};
+        } else if constexpr (sizeof(T) < sizeof(std::uint64_t) && std::atomic<std::uint64_t>::is_always_lock_free) {
+            return std::uint64_t{};
+        }
+    }
+
+    template<typename T>
+    using cas_word_t = decltype(cas_word<T>());
+} // namespace detail
+
+// Whether atomic_synchronized_value<T> exists for T: trivially copyable and
+// small enough to share a lock-free atomic word with a lock byte (up to 7
+// bytes on 64-bit targets - int, float, small structs)
+template<typename T>
+constexpr bool is_cas_applicable_v = std::is_trivially_copyable_v<T> && !std::is_void_v<detail::cas_word_t<T>>;
+
+// Lock-free flavour of synchronized_value for small values: T lives in a
+// single atomic word, next to a lock byte.
+//
+//  - apply() on this value alone copies it, runs f on the copy and publishes
+//    the result with compare_exchange, rerunning f if another writer got in
+//    first; const apply() just reads a copy. No mutex, no lock word write.
+//  - apply() together with other values locks it by setting the lock byte
+//    (writers of the line above wait for it to clear), so it composes with
+//    mutex-backed values like any other flavour; f's changes are committed
+//    only if f returns normally.
+//
+// Restriction: f may run several times, always on a private copy, and only
+// the run whose result was published counts - so f must have no side effects
+// besides modifying its argument (no I/O, no other shared state, nothing that
+// must happen exactly once); apply() returns what that last run returned.
+// BM::defer() is fine: only the published run's actions are kept.
+template<class T>
+class atomic_synchronized_value {
+    static_assert(is_cas_applicable_v<T>,
+                  "T must be trivially copyable and fit a lock-free word with a byte to spare, "
+                  "see cas_synchronized_value for a fallback");
+
+public:
+    using value_type = T;
+
+private:
+    using word = detail::cas_word_t<T>;
+    using word_bytes = std::array<std::byte, sizeof(word)>;
+
+    // The lock byte is the last one, T takes the first sizeof(T)
+    static constexpr word locked = [] {
+        word_bytes b{};
+        b.back() = std::byte{1};
+        return std::bit_cast<word>(b);
+    }();
+
+    mutable std::atomic<word> state;
+
+    template<SynchronisedValueLike SV>
+    friend class synchronized_value_lockable_adapter;
+
+    template<typename F, typename T0, SynchronisedValueLike... SVs>
+    friend auto apply(F&& f, atomic_synchronized_value<T0>& sv0, SVs&&... svs);
+
+    template<typename F, typename T0, SynchronisedValueLike... SVs>
+    friend auto apply(F&& f, const atomic_synchronized_value<T0>& sv0, SVs&&... svs);
+
+    static word pack(const T& value) {
+        word_bytes b{};
+        std::memcpy(b.data(), &value, sizeof(T));
+        return std::bit_cast<word>(b);
+    }
+
+    static T unpack(word w) {
+        auto b = std::bit_cast<word_bytes>(w);
+        std::array<std::byte, sizeof(T)> v;
+        std::copy_n(b.begin(), sizeof(T), v.begin());
+        return std::bit_cast<T>(v);
+    }
+
+    // Current word, once no multi-value apply() holds the value
+    word load_unlocked() const {
+        word w = state.load(std::memory_order_acquire);
+        while (w & locked) {
+            std::this_thread::yield();
+            w = state.load(std::memory_order_acquire);
+        }
+        return w;
+    }
+
+    void notify_waiters() const {
+        if (detail::wait_table::has_waiters()) {
+            detail::wait_table::notify(reinterpret_cast<std::uintptr_t>(&state), false);
+        }
+    }
+
+    // BM::defer()red actions run once, for the attempt that got published
+    template<typename F>
+    auto update(F& f) {
+        detail::defer_scope deferred;
+        word w = load_unlocked();
+        for (;;) {
+            T copy = unpack(w);
+            if constexpr (std::is_void_v<std::invoke_result_t<F&, T&>>) {
+                std::invoke(f, copy);
+                if (publish(w, copy)) {
+                    return;
+                }
+            } else {
+                auto result = std::invoke(f, copy);
+                if (publish(w, copy)) {
+                    return result;
+                }
+            }
+            deferred.discard();
+        }
+    }
+
+    // false (and w reloaded) if another writer came first
+    bool publish(word& w, const T& copy) {
+        word next = pack(copy);
+        if (next == w) {
+            return true;    // unchanged, nothing to write
+        }
+        if (state.compare_exchange_weak(w, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            notify_waiters();
+            return true;
+        }
+        if (w & locked) {
+            w = load_unlocked();
+        }
+        return false;
+    }
+
+    template<typename F>
+    auto read(F& f) const {
+        detail::defer_scope deferred;
+        const T copy = unpack(load_unlocked());
+        return std::invoke(f, copy);
+    }
+
+    // Multi-value apply(): the lock byte keeps writers and other lockers out
+    word lock() const {
+        word w = state.load(std::memory_order_relaxed);
+        for (;;) {
+            if (!(w & locked)) {
+                if (state.compare_exchange_weak(w, w | locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return w;
+                }
+                continue;
+            }
+            std::this_thread::yield();
+            w = state.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::optional<word> try_lock() const {
+        word w = state.load(std::memory_order_relaxed);
+        while (!(w & locked)) {
+            if (state.compare_exchange_weak(w, w | locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return w;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // With the lock byte set, only the holder writes the word
+    void commit(const T& value) {
+        state.store(pack(value) | locked, std::memory_order_relaxed);
+    }
+
+    void unlock() const {
+        state.store(state.load(std::memory_order_relaxed) & ~locked, std::memory_order_release);
+    }
+
+public:
+    atomic_synchronized_value(const atomic_synchronized_value&) = delete;
+    atomic_synchronized_value& operator=(const atomic_synchronized_value&) = delete;
+    atomic_synchronized_value(atomic_synchronized_value&&) = delete;
+    atomic_synchronized_value& operator=(atomic_synchronized_value&&) = delete;
+
+    template<class... Args>
+    atomic_synchronized_value(Args&&... args)
+        requires (sizeof...(Args) != 1 ||
+                 (!std::same_as<atomic_synchronized_value, std::remove_cvref_t<Args>> && ...)) &&
+                 std::is_constructible_v<T, Args...>
+        : state(pack(T(std::forward<Args>(args)...))) {}
+};
+
+// atomic_synchronized_value<T> where T allows it, synchronized_value<T, Fallback>
+// otherwise - the same apply()-based code either way:
+//   cas_synchronized_value<Account::FinancialData> money;   // lock-free
+//   cas_synchronized_value<std::array<long, 4>> totals;      // mutex-backed
+template<class T, Lockable Fallback = std::mutex>
+using cas_synchronized_value =
+    std::conditional_t<is_cas_applicable_v<T>, atomic_synchronized_value<T>, synchronized_value<T, Fallback>>;
+
+template<typename T>
+struct is_atomic_synchronized_value : std::false_type {};
+
+template<typename T>
+struct is_atomic_synchronized_value<atomic_synchronized_value<T>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_atomic_synchronized_value_v = is_atomic_synchronized_value<std::remove_cvref_t<T>>::value;
+
+template<typename T>
+struct is_synchronized_value_like<atomic_synchronized_value<T>> : std::true_type {};
+
+// Adapter for multi-value apply(): locking sets the lock byte and takes a
+// copy for f, non-const values write it back in commit()
+template<SynchronisedValueLike SyncValue>
+    requires is_atomic_synchronized_value_v<SyncValue>
+class synchronized_value_lockable_adapter<SyncValue> {
+private:
+    using atomic_type = std::remove_cvref_t<SyncValue>;
+    using T = typename atomic_type::value_type;
+
+    static constexpr bool writer = !std::is_const_v<std::remove_reference_t<SyncValue>>;
+
+    std::remove_reference_t<SyncValue>& sv;
+    mutable std::optional<T> copy;
+
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
+    friend auto detail::apply_impl(F&& f, SV0&& sv0, SVs&&... svs);
+
+    template<typename F, typename... SVs>
+    friend auto detail::try_apply_impl(const detail::deadline& d, F&& f, SVs&&... svs);
+
+    template<SynchronisedValueLike SV>
+    friend auto detail::make_lockable_adapter(SV&& sv);
+
+    synchronized_value_lockable_adapter(SyncValue&& sv) : sv(sv) {}
+
+public:
+    void lock() {
+        copy = atomic_type::unpack(sv.lock());
+    }
+
+    bool try_lock() {
+        if (auto w = sv.try_lock()) {
+            copy = atomic_type::unpack(*w);
+            return true;
+        }
+        return false;
+    }
+
+    void unlock() {
+        copy.reset();
+        sv.unlock();
+    }
+
+    lock_order_key lock_order() const {
+        return {lock_rank_v<atomic_type>, reinterpret_cast<std::uintptr_t>(&sv.state)};
+    }
+
+    auto value() const -> auto& {
+        if constexpr (writer) {
+            return *copy;
+        } else {
+            return std::as_const(*copy);
+        }
+    }
+
+    void commit() requires writer {
+        sv.commit(*copy);
+    }
+};
+
+// Apply overloads with an atomic value first (see synchronized_value.hpp for
+// why the first parameter has to be spelled out): alone it takes the CAS
+// path, together with other values it is locked like they are
+template<typename F, typename T0, SynchronisedValueLike... SVs>
+auto apply(F&& f, atomic_synchronized_value<T0>& sv0, SVs&&... svs)
+{
+    if constexpr (sizeof...(SVs) == 0) {
+        return sv0.update(f);
+    } else {
+        return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+    }
+}
+
+template<typename F, typename T0, SynchronisedValueLike... SVs>
+auto apply(F&& f, const atomic_synchronized_value<T0>& sv0, SVs&&... svs)
+{
+    if constexpr (sizeof...(SVs) == 0) {
+        return sv0.read(f);
+    } else {
+        return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+    }
+}
+
+} // namespace BM
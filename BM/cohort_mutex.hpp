@@ -0,0 +1,182 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+#include "parking_lot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace BM {
+
+// CPU -> NUMA node map, read from sysfs (node<N>/cpulist). Anything missing
+// or unreadable - no sysfs, no NUMA support, a CPU not listed - counts as
+// node 0, so a single-node machine simply gets one node.
+class numa_topology {
+    std::vector<unsigned> node_of_cpu;
+    unsigned nodes = 1;
+
+    // "0-3,8,10-11" -> calls f(cpu) for 0,1,2,3,8,10,11
+    template<typename F>
+    static void for_each_cpu(const std::string& list, F&& f) {
+        std::size_t pos = 0;
+        while (pos < list.size()) {
+            char* end;
+            unsigned long first = std::strtoul(list.c_str() + pos, &end, 10);
+            if (end == list.c_str() + pos) {
+                return;
+            }
+            unsigned long last = first;
+            if (*end == '-') {
+                last = std::strtoul(end + 1, &end, 10);
+            }
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                f(static_cast<unsigned>(cpu));
+            }
+            pos = static_cast<std::size_t>(end - list.c_str()) + 1;
+        }
+    }
+
+public:
+    explicit numa_topology(const std::filesystem::path& sysfs = "/sys/devices/system/node") {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(sysfs, ec)) {
+            auto name = entry.path().filename().string();
+            if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+                !std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                continue;
+            }
+            auto node = static_cast<unsigned>(std::stoul(name.substr(4)));
+            std::string cpus;
+            std::getline(std::ifstream(entry.path() / "cpulist"), cpus);
+            for_each_cpu(cpus, [&](unsigned cpu) {
+                if (cpu >= node_of_cpu.size()) {
+                    node_of_cpu.resize(cpu + 1, 0);
+                }
+                node_of_cpu[cpu] = node;
+                nodes = std::max(nodes, node + 1);
+            });
+        }
+    }
+
+    // Detected once, on first use
+    static const numa_topology& system() {
+        static const numa_topology topology;
+        return topology;
+    }
+
+    unsigned node_count() const { return nodes; }
+
+    unsigned node_of(unsigned cpu) const {
+        return cpu < node_of_cpu.size() ? node_of_cpu[cpu] : 0;
+    }
+
+    // Node of the CPU the calling thread runs on right now (it may migrate)
+    unsigned current_node() const {
+        if (nodes == 1) {
+            return 0;
+        }
+#if defined(__linux__)
+        int cpu = sched_getcpu();
+        return cpu < 0 ? 0 : node_of(static_cast<unsigned>(cpu));
+#else
+        return 0;
+#endif
+    }
+};
+
+// Cohort lock (Dice, Marathe, Shavit: "Lock Cohorting") for multi-socket hosts.
+//
+// A global lock plus one local lock per NUMA node. Threads first take their
+// node's local lock; the first of a node also takes the global one. On
+// unlock(), if another thread of the same node is waiting, only the local
+// lock is released and the global one passes to it - the value and the lock
+// words stay in that node's caches instead of crossing the interconnect on
+// every apply(). After MaxBatch hand-offs in a row the global lock is
+// released anyway, so other nodes are not starved.
+//
+// The global lock is released by whichever thread of the cohort holds it
+// last, so it has to be thread-oblivious: parking_lot_mutex. Local is only
+// ever unlocked by the thread that locked it. On a single node the cohort
+// lock is a local lock in front of an (always uncontended) global one.
+template<Lockable Local = parking_lot_mutex<>, unsigned MaxBatch = 64>
+class cohort_mutex {
+    static_assert(MaxBatch > 0);
+
+    struct alignas(cache_line_size) cohort {
+        Local local;
+        std::atomic<unsigned> waiting{0};   // threads of this node in lock()
+        bool owns_global = false;           // guarded by local
+        unsigned batch = 0;                 // guarded by local
+    };
+
+    parking_lot_mutex<> global;
+    unsigned owner_node = 0;                // guarded by the lock itself
+    std::unique_ptr<cohort[]> cohorts;
+
+    // With c.local held
+    void join(cohort& c, unsigned node) {
+        if (!c.owns_global) {
+            global.lock();
+            c.owns_global = true;
+            c.batch = 0;
+        }
+        owner_node = node;
+    }
+
+public:
+    cohort_mutex() : cohorts(std::make_unique<cohort[]>(numa_topology::system().node_count())) {}
+    cohort_mutex(const cohort_mutex&) = delete;
+    cohort_mutex& operator=(const cohort_mutex&) = delete;
+
+    // Lockable
+    void lock() {
+        auto node = numa_topology::system().current_node();
+        cohort& c = cohorts[node];
+        c.waiting.fetch_add(1, std::memory_order_relaxed);
+        c.local.lock();
+        c.waiting.fetch_sub(1, std::memory_order_relaxed);
+        join(c, node);
+    }
+
+    bool try_lock() {
+        auto node = numa_topology::system().current_node();
+        cohort& c = cohorts[node];
+        if (!c.local.try_lock()) {
+            return false;
+        }
+        if (!c.owns_global) {
+            if (!global.try_lock()) {
+                c.local.unlock();
+                return false;
+            }
+            c.owns_global = true;
+            c.batch = 0;
+        }
+        owner_node = node;
+        return true;
+    }
+
+    void unlock() {
+        cohort& c = cohorts[owner_node];
+        if (c.waiting.load(std::memory_order_relaxed) > 0 && ++c.batch < MaxBatch) {
+            // keep the global lock in this cohort, the waiter inherits it
+            c.local.unlock();
+            return;
+        }
+        c.owns_global = false;
+        global.unlock();
+        c.local.unlock();
+    }
+};
+
+} // namespace BM
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace BM {
+
+// Flat-combining mutex for hot single values (counters, ledgers).
+//
+// Uncontended, apply() on a single value behaves as with Mutex: try_lock(),
+// run f, unlock(). Once failed try_lock()s show the lock is contended, callers
+// switch to combining instead: each publishes its critical section in a slot
+// and waits; whichever waiter gets the lock runs every published critical
+// section in one pass and hands back results (and exceptions). The value and
+// the lock word stay in the combiner's cache instead of travelling between
+// cores on every call. Combining switches itself off again when passes find
+// nobody else waiting.
+//
+// Notes:
+//  - f may run on another thread: it must not rely on thread_local state or
+//    on which thread holds locks (what it BM::defer()s still runs on the
+//    calling thread, after its apply() is done)
+//  - apply() with several values locks it like a plain mutex, which
+//    serializes with combining passes
+template<Lockable Mutex = std::mutex, std::size_t Slots = 16>
+class flat_combining_mutex {
+    struct request {
+        void (*fn)(void*);
+        void* arg;
+        std::exception_ptr error;
+        std::atomic<bool> done{false};
+    };
+
+    static constexpr unsigned max_heat = 64;
+    static constexpr unsigned combining_heat = 16;  // ~4 failed try_lock()s in a row
+
+    Mutex mut;
+    std::atomic<unsigned> heat{0};
+    std::array<std::atomic<request*>, Slots> slots{};
+
+    bool combining() const {
+        return heat.load(std::memory_order_relaxed) >= combining_heat;
+    }
+
+    void warm_up(unsigned by) {
+        auto h = heat.load(std::memory_order_relaxed);
+        if (h < max_heat) {
+            heat.store(std::min(h + by, max_heat), std::memory_order_relaxed);
+        }
+    }
+
+    void cool_down() {
+        auto h = heat.load(std::memory_order_relaxed);
+        if (h > 0) {
+            heat.store(h - 1, std::memory_order_relaxed);
+        }
+    }
+
+    static void run(request& r) {
+        try {
+            r.fn(r.arg);
+        } catch (...) {
+            r.error = std::current_exception();
+        }
+    }
+
+    // With mut held: run everything published so far
+    void combine_pass() {
+        unsigned served = 0;
+        for (auto& slot : slots) {
+            if (auto* r = slot.load(std::memory_order_acquire)) {
+                slot.store(nullptr, std::memory_order_relaxed);
+                run(*r);
+                r->done.store(true, std::memory_order_release);
+                ++served;
+            }
+        }
+        if (served > 1) {
+            warm_up(served);
+        } else {
+            cool_down();
+        }
+    }
+
+    bool publish(request& r) {
+        auto first = detail::thread_index();
+        for (std::size_t i = 0; i < Slots; ++i) {
+            request* empty = nullptr;
+            if (slots[(first + i) % Slots].compare_exchange_strong(empty, &r, std::memory_order_release,
+                                                                   std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void locked_call(void (*fn)(void*), void* arg) {
+        std::lock_guard lock(mut, std::adopt_lock);
+        fn(arg);
+    }
+
+public:
+    // Lockable
+    void lock() { mut.lock(); }
+    bool try_lock() { return mut.try_lock(); }
+    void unlock() { mut.unlock(); }
+
+    // CombiningLockable
+    void combine(void (*fn)(void*), void* arg) {
+        if (!combining()) {
+            if (mut.try_lock()) {
+                cool_down();
+                return locked_call(fn, arg);
+            }
+            warm_up(4);
+            if (!combining()) {
+                mut.lock();
+                return locked_call(fn, arg);
+            }
+        }
+
+        request r{fn, arg, nullptr};
+        if (!publish(r)) {
+            mut.lock();
+            return locked_call(fn, arg);
+        }
+        for (unsigned spins = 0; !r.done.load(std::memory_order_acquire); ++spins) {
+            if (mut.try_lock()) {
+                std::lock_guard lock(mut, std::adopt_lock);
+                combine_pass();
+            } else if (spins >= 64) {
+                std::this_thread::yield();
+            }
+        }
+        if (r.error) {
+            std::rethrow_exception(r.error);
+        }
+    }
+};
+
+template<class T, Lockable Mutex = std::mutex, LayoutPolicy Layout = layout::compact>
+using combining_synchronized_value = synchronized_value<T, flat_combining_mutex<Mutex>, Layout>;
+
+} // namespace BM
@@ -0,0 +1,517 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace BM {
+
+// Merged view of one stats_mutex's counters
+struct lock_stats_snapshot {
+    static constexpr std::size_t buckets = 40;     // bucket i: [2^(i-1), 2^i) ns, bucket 0: 0 ns
+    static constexpr std::size_t max_arity = 16;   // applies_by_arity[max_arity] counts 16+
+
+    std::uint64_t acquisitions = 0;         // lock() + successful try_lock()
+    std::uint64_t contended = 0;            // lock() that could not take the try_lock() fast path
+    std::uint64_t failed_try_locks = 0;     // try_lock() returning false (e.g. std::lock() back-off)
+    std::uint64_t shared_acquisitions = 0;
+    std::uint64_t shared_contended = 0;
+    std::array<std::uint64_t, buckets> wait_ns{};  // time spent blocked in lock()/lock_shared()
+    std::array<std::uint64_t, buckets> hold_ns{};  // exclusive lock() to unlock()
+    std::array<std::uint64_t, max_arity + 1> applies_by_arity{};
+
+    static std::size_t bucket(std::uint64_t ns) {
+        return std::min<std::size_t>(std::bit_width(ns), buckets - 1);
+    }
+
+    // Upper bound of the bucket holding the p-th percentile (0 <= p <= 1)
+    static std::uint64_t percentile(const std::array<std::uint64_t, buckets>& hist, double p) {
+        std::uint64_t total = 0;
+        for (auto n : hist) total += n;
+        auto rank = static_cast<std::uint64_t>(p * total);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets; ++i) {
+            seen += hist[i];
+            if (seen > rank) {
+                return i == 0 ? 0 : (std::uint64_t{1} << i) - 1;
+            }
+        }
+        return 0;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const lock_stats_snapshot& s) {
+        os << "acquisitions=" << s.acquisitions
+           << " contended=" << s.contended
+           << " failed_try_locks=" << s.failed_try_locks
+           << " shared_acquisitions=" << s.shared_acquisitions
+           << " shared_contended=" << s.shared_contended
+           << " wait_ns_p50=" << percentile(s.wait_ns, 0.50)
+           << " wait_ns_p99=" << percentile(s.wait_ns, 0.99)
+           << " hold_ns_p50=" << percentile(s.hold_ns, 0.50)
+           << " hold_ns_p99=" << percentile(s.hold_ns, 0.99)
+           << " applies_by_arity=";
+        const char* sep = "";
+        for (std::size_t a = 1; a <= max_arity; ++a) {
+            if (s.applies_by_arity[a]) {
+                os << sep << a << (a == max_arity ? "+:" : ":") << s.applies_by_arity[a];
+                sep = ",";
+            }
+        }
+        return os;
+    }
+};
+
+
+namespace detail {
+    // The counters behind one lock_stats_snapshot, as one thread saw them.
+    // Only that thread writes them, so counting is a plain load and store -
+    // no locked instruction, no cache line shared with other threads.
+    struct lock_stats_counters {
+        using counter = std::atomic<std::uint64_t>;
+        static constexpr std::size_t buckets = lock_stats_snapshot::buckets;
+        static constexpr std::size_t max_arity = lock_stats_snapshot::max_arity;
+
+        counter acquisitions{0};
+        counter contended{0};
+        counter failed_try_locks{0};
+        counter shared_acquisitions{0};
+        counter shared_contended{0};
+        std::array<counter, buckets> wait_ns{};
+        std::array<counter, buckets> hold_ns{};
+        std::array<counter, max_arity + 1> applies_by_arity{};
+
+        static void bump(counter& c) {
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // f(a.x, b.x) for every counter x of a and the same-named field of b
+        // (lock_stats_counters or lock_stats_snapshot)
+        template<typename A, typename B, typename F>
+        static void zip(A& a, B& b, F f) {
+            f(a.acquisitions, b.acquisitions);
+            f(a.contended, b.contended);
+            f(a.failed_try_locks, b.failed_try_locks);
+            f(a.shared_acquisitions, b.shared_acquisitions);
+            f(a.shared_contended, b.shared_contended);
+            for (std::size_t i = 0; i < buckets; ++i) {
+                f(a.wait_ns[i], b.wait_ns[i]);
+                f(a.hold_ns[i], b.hold_ns[i]);
+            }
+            for (std::size_t i = 0; i <= max_arity; ++i) {
+                f(a.applies_by_arity[i], b.applies_by_arity[i]);
+            }
+        }
+    };
+
+    // One thread's counters, by registry slot: 16 slots to a chunk, chunks
+    // allocated on first use, so a thread pays for the values it touched
+    // (about 13 KB per 16 slots), not for every stats_mutex there is. Chunks
+    // never move: other threads read them (under the registry lock) while
+    // the owner counts.
+    class lock_stats_table {
+        static constexpr std::size_t chunk_slots = 16;
+        static constexpr std::size_t dir_chunks = 1024;
+        static constexpr std::size_t top_dirs = 1024;
+
+        using chunk = std::array<lock_stats_counters, chunk_slots>;
+        using dir = std::array<std::atomic<chunk*>, dir_chunks>;
+
+        std::array<std::atomic<dir*>, top_dirs> top{};
+
+    public:
+        static constexpr std::size_t max_slots = chunk_slots * dir_chunks * top_dirs;
+
+        lock_stats_table() = default;
+        lock_stats_table(const lock_stats_table&) = delete;
+        lock_stats_table& operator=(const lock_stats_table&) = delete;
+
+        ~lock_stats_table() {
+            for (auto& d : top) {
+                if (dir* p = d.load(std::memory_order_relaxed)) {
+                    for (auto& c : *p) {
+                        delete c.load(std::memory_order_relaxed);
+                    }
+                    delete p;
+                }
+            }
+        }
+
+        // By the owning thread only (for the retired table: under the lock)
+        lock_stats_counters& at(std::size_t slot) {
+            auto& d = top[slot / (chunk_slots * dir_chunks)];
+            dir* p = d.load(std::memory_order_relaxed);
+            if (!p) [[unlikely]] {
+                p = new dir{};
+                d.store(p, std::memory_order_release);
+            }
+            auto& c = (*p)[slot / chunk_slots % dir_chunks];
+            chunk* q = c.load(std::memory_order_relaxed);
+            if (!q) [[unlikely]] {
+                q = new chunk{};
+                c.store(q, std::memory_order_release);
+            }
+            return (*q)[slot % chunk_slots];
+        }
+
+        // By anyone, nullptr if the owner never counted into slot's chunk
+        lock_stats_counters* find(std::size_t slot) const {
+            dir* p = top[slot / (chunk_slots * dir_chunks)].load(std::memory_order_acquire);
+            if (!p) {
+                return nullptr;
+            }
+            chunk* q = (*p)[slot / chunk_slots % dir_chunks].load(std::memory_order_acquire);
+            return q ? &(*q)[slot % chunk_slots] : nullptr;
+        }
+    };
+
+    // Slots of the live stats_mutexes (and groups) with their names, and the
+    // tables of the live threads: a slot's statistics are the sum of its
+    // counters over all tables, plus what threads that exited counted
+    class lock_stats_registry {
+        struct entry {
+            const void* owner = nullptr;   // nullptr = free slot
+            std::string name;
+        };
+
+        std::mutex m;
+        std::vector<entry> slots;
+        std::vector<std::size_t> free_slots;
+        std::vector<lock_stats_table*> threads;
+        lock_stats_table retired;
+
+        lock_stats_snapshot sum(std::size_t slot) {
+            lock_stats_snapshot out;
+            auto add = [&](const lock_stats_counters* c) {
+                if (c) {
+                    lock_stats_counters::zip(*c, out, [](const auto& from, auto& to) {
+                        to += from.load(std::memory_order_relaxed);
+                    });
+                }
+            };
+            add(retired.find(slot));
+            for (const lock_stats_table* t : threads) {
+                add(t->find(slot));
+            }
+            return out;
+        }
+
+    public:
+        static lock_stats_registry& instance() {
+            static lock_stats_registry registry;
+            return registry;
+        }
+
+        std::size_t add(const void* owner) {
+            std::lock_guard l(m);
+            std::size_t slot;
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                if (slots.size() == lock_stats_table::max_slots) {
+                    throw std::length_error("BM::stats_mutex: too many live instances");
+                }
+                slot = slots.size();
+                slots.emplace_back();
+            }
+            slots[slot].owner = owner;
+            return slot;
+        }
+
+        // Zeroes the slot everywhere for whoever gets it next; nobody counts
+        // into it any more, its owner is gone
+        void remove(std::size_t slot) {
+            std::lock_guard l(m);
+            auto clear = [](lock_stats_counters* c) {
+                if (c) {
+                    lock_stats_counters::zip(*c, *c, [](auto& x, auto&) { x.store(0, std::memory_order_relaxed); });
+                }
+            };
+            clear(retired.find(slot));
+            for (lock_stats_table* t : threads) {
+                clear(t->find(slot));
+            }
+            slots[slot] = entry{};
+            free_slots.push_back(slot);
+        }
+
+        void set_name(std::size_t slot, std::string name) {
+            std::lock_guard l(m);
+            slots[slot].name = std::move(name);
+        }
+
+        void add_thread(lock_stats_table* t) {
+            std::lock_guard l(m);
+            threads.push_back(t);
+        }
+
+        // An exiting thread leaves its counts to the live slots
+        void remove_thread(const lock_stats_table* t) {
+            std::lock_guard l(m);
+            for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+                if (slots[slot].owner) {
+                    if (const lock_stats_counters* c = t->find(slot)) {
+                        lock_stats_counters::zip(*c, retired.at(slot), [](const auto& from, auto& to) {
+                            to.store(to.load(std::memory_order_relaxed) + from.load(std::memory_order_relaxed),
+                                     std::memory_order_relaxed);
+                        });
+                    }
+                }
+            }
+            std::erase(threads, t);
+        }
+
+        lock_stats_snapshot snapshot(std::size_t slot) {
+            std::lock_guard l(m);
+            return sum(slot);
+        }
+
+        // Unnamed slots by their owner's address
+        std::vector<std::pair<std::string, lock_stats_snapshot>> collect() {
+            std::lock_guard l(m);
+            std::vector<std::pair<std::string, lock_stats_snapshot>> out;
+            for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+                const auto& [owner, name] = slots[slot];
+                if (!owner) {
+                    continue;
+                }
+                if (name.empty()) {
+                    char buf[2 + 2 * sizeof(void*) + 1];
+                    std::snprintf(buf, sizeof buf, "%p", owner);
+                    out.emplace_back(buf, sum(slot));
+                } else {
+                    out.emplace_back(name, sum(slot));
+                }
+            }
+            return out;
+        }
+    };
+
+    // This thread's table, registered from the first count until the thread
+    // exits (on the heap: threads that never count pay one pointer)
+    class lock_stats_thread {
+        std::unique_ptr<lock_stats_table> table = std::make_unique<lock_stats_table>();
+
+        lock_stats_thread() { lock_stats_registry::instance().add_thread(table.get()); }
+        ~lock_stats_thread() { lock_stats_registry::instance().remove_thread(table.get()); }
+
+    public:
+        static lock_stats_table& local() {
+            thread_local lock_stats_thread t;
+            return *t.table;
+        }
+    };
+
+    // The identity of one stats_mutex (or group) in every thread's table,
+    // for as long as it lives
+    class lock_stats_slot {
+        std::size_t slot = lock_stats_registry::instance().add(this);
+
+    public:
+        lock_stats_slot() = default;
+        ~lock_stats_slot() { lock_stats_registry::instance().remove(slot); }
+
+        lock_stats_slot(const lock_stats_slot&) = delete;
+        lock_stats_slot& operator=(const lock_stats_slot&) = delete;
+
+        lock_stats_counters& local() const { return lock_stats_thread::local().at(slot); }
+
+        lock_stats_snapshot snapshot() const { return lock_stats_registry::instance().snapshot(slot); }
+
+        void set_name(std::string name) const { lock_stats_registry::instance().set_name(slot, std::move(name)); }
+    };
+
+    // Mutex wrapper doing the counting, into Derived::counters()
+    template<typename Derived, Lockable Mutex>
+    class stats_mutex_base {
+        using clock = std::chrono::steady_clock;
+
+        Mutex mut;
+        clock::time_point locked_at;   // written and read by the owner only
+
+        auto& local() { return static_cast<Derived&>(*this).counters().local(); }
+
+        static void bump(std::atomic<std::uint64_t>& c) { lock_stats_counters::bump(c); }
+
+        static std::uint64_t ns(clock::duration d) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        }
+
+    public:
+        // Lockable
+        void lock() {
+            auto& s = local();
+            if (mut.try_lock()) {
+                bump(s.wait_ns[0]);
+                locked_at = clock::now();
+            } else {
+                auto t0 = clock::now();
+                mut.lock();
+                locked_at = clock::now();
+                bump(s.contended);
+                bump(s.wait_ns[lock_stats_snapshot::bucket(ns(locked_at - t0))]);
+            }
+            bump(s.acquisitions);
+        }
+
+        bool try_lock() {
+            auto& s = local();
+            if (!mut.try_lock()) {
+                bump(s.failed_try_locks);
+                return false;
+            }
+            locked_at = clock::now();
+            bump(s.acquisitions);
+            return true;
+        }
+
+        void unlock() {
+            auto held = clock::now() - locked_at;
+            bump(local().hold_ns[lock_stats_snapshot::bucket(ns(held))]);
+            mut.unlock();
+        }
+
+        // SharedLockable, when the wrapped mutex is (no hold times, there may be many holders)
+        void lock_shared() requires SharedLockable<Mutex> {
+            auto& s = local();
+            if (mut.try_lock_shared()) {
+                bump(s.wait_ns[0]);
+            } else {
+                auto t0 = clock::now();
+                mut.lock_shared();
+                bump(s.shared_contended);
+                bump(s.wait_ns[lock_stats_snapshot::bucket(ns(clock::now() - t0))]);
+            }
+            bump(s.shared_acquisitions);
+        }
+
+        bool try_lock_shared() requires SharedLockable<Mutex> {
+            auto& s = local();
+            if (!mut.try_lock_shared()) {
+                bump(s.failed_try_locks);
+                return false;
+            }
+            bump(s.shared_acquisitions);
+            return true;
+        }
+
+        void unlock_shared() requires SharedLockable<Mutex> {
+            mut.unlock_shared();
+        }
+
+        // Called by apply() for every value it is about to lock
+        void on_apply(std::size_t arity) {
+            bump(local().applies_by_arity[std::min(arity, lock_stats_snapshot::max_arity)]);
+        }
+
+        lock_stats_snapshot snapshot() const { return static_cast<const Derived&>(*this).counters().snapshot(); }
+
+        // For dump_lock_stats(), instead of an address; names the whole
+        // group for a group_stats_mutex
+        void set_name(std::string name) { static_cast<Derived&>(*this).counters().set_name(std::move(name)); }
+    };
+} // namespace detail
+
+// Opt-in statistics policy: a Mutex wrapper counting what happens to the
+// mutex it wraps, e.g. synchronized_value<T, stats_mutex<std::mutex>>.
+//
+// Every thread counts into counters of its own, so turning statistics on
+// adds no cache line that all threads write to. The mutex itself only holds
+// its slot in the per-thread tables (stats_mutex<std::mutex> is 56 bytes);
+// each thread that locks it spends about 800 bytes on its counters, until
+// the mutex goes away. lock_stats() sums them up.
+template<Lockable Mutex = std::mutex>
+class stats_mutex : public detail::stats_mutex_base<stats_mutex<Mutex>, Mutex> {
+    friend class detail::stats_mutex_base<stats_mutex, Mutex>;
+
+    detail::lock_stats_slot slot;
+
+    const detail::lock_stats_slot& counters() const { return slot; }
+
+public:
+    stats_mutex() = default;
+};
+
+namespace detail {
+    // One slot per group, for all its mutexes; named Group::name if there is one
+    template<typename Group>
+    const lock_stats_slot& group_slot() {
+        static const lock_stats_slot slot;
+        static const bool named = [] {
+            if constexpr (requires { std::string(Group::name); }) {
+                slot.set_name(std::string(Group::name));
+            }
+            return true;
+        }();
+        (void)named;
+        return slot;
+    }
+} // namespace detail
+
+// stats_mutex counting into one slot shared by every mutex of Group (any
+// type, e.g. a tag struct with a `static constexpr const char* name`): what
+// it costs per value is the wrapped mutex plus 8 bytes, and threads spend
+// one set of counters on the whole group. lock_stats() and dump_lock_stats()
+// report the group as a whole.
+//   struct accounts { static constexpr const char* name = "accounts"; };
+//   synchronized_value<Account, group_stats_mutex<accounts>> account;
+template<typename Group, Lockable Mutex = std::mutex>
+class group_stats_mutex : public detail::stats_mutex_base<group_stats_mutex<Group, Mutex>, Mutex> {
+    friend class detail::stats_mutex_base<group_stats_mutex, Mutex>;
+
+    static const detail::lock_stats_slot& counters() { return detail::group_slot<Group>(); }
+
+public:
+    group_stats_mutex() { counters(); }   // listed from the first value on
+};
+
+template<typename M>
+struct is_stats_mutex : std::false_type {};
+
+template<typename M>
+struct is_stats_mutex<stats_mutex<M>> : std::true_type {};
+
+template<typename G, typename M>
+struct is_stats_mutex<group_stats_mutex<G, M>> : std::true_type {};
+
+// Statistics of one value guarded by a stats_mutex (of its group, for a
+// group_stats_mutex)
+template<typename SV>
+    requires SynchronisedValueLike<SV> && is_stats_mutex<typename std::remove_cvref_t<SV>::mutex_type>::value
+lock_stats_snapshot lock_stats(const SV& sv) {
+    return detail::get_mutex_ref(sv).snapshot();
+}
+
+template<typename SV>
+    requires SynchronisedValueLike<SV> && is_stats_mutex<typename std::remove_cvref_t<SV>::mutex_type>::value
+void set_lock_stats_name(SV& sv, std::string name) {
+    detail::get_mutex_ref(sv).set_name(std::move(name));
+}
+
+// Statistics of every live stats_mutex, by name
+inline std::vector<std::pair<std::string, lock_stats_snapshot>> collect_lock_stats() {
+    return detail::lock_stats_registry::instance().collect();
+}
+
+// One line per live stats_mutex: "<name> acquisitions=... contended=... ..."
+inline void dump_lock_stats(std::ostream& os) {
+    for (const auto& [name, stats] : collect_lock_stats()) {
+        os << name << ' ' << stats << '\n';
+    }
+}
+
+} // namespace BM
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+#include "parking_lot.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+namespace BM {
+
+namespace detail {
+    // Queue node of an MCS lock, on a cache line of its own: each waiter
+    // spins on its own node only
+    struct alignas(cache_line_size) mcs_node {
+        static constexpr std::uint8_t granted = 0;
+        static constexpr std::uint8_t waiting = 1;
+        static constexpr std::uint8_t parked = 2;
+
+        std::atomic<mcs_node*> next{nullptr};
+        std::atomic<std::uint8_t> state{waiting};
+        mcs_node* free_next = nullptr;
+    };
+
+    // Per-thread stock of queue nodes. A thread needs one per MCS lock it
+    // holds or waits for (apply() on several values holds several), nodes
+    // are only freed when the thread exits.
+    class mcs_node_pool {
+        mcs_node* free = nullptr;
+
+    public:
+        static mcs_node_pool& local() {
+            thread_local mcs_node_pool pool;
+            return pool;
+        }
+
+        ~mcs_node_pool() {
+            while (free) {
+                delete std::exchange(free, free->free_next);
+            }
+        }
+
+        mcs_node* get() {
+            mcs_node* n = free ? std::exchange(free, free->free_next) : new mcs_node;
+            n->next.store(nullptr, std::memory_order_relaxed);
+            n->state.store(mcs_node::waiting, std::memory_order_relaxed);
+            return n;
+        }
+
+        void put(mcs_node* n) {
+            n->free_next = std::exchange(free, n);
+        }
+    };
+} // namespace detail
+
+// MCS queue lock (Mellor-Crummey & Scott): FIFO hand-off, so no thread can
+// be starved, and every waiter spins on its own queue node instead of all
+// of them hammering one lock word - unlock() touches the lock word and the
+// successor's node only.
+//
+// Queue nodes come from a per-thread pool and the owner's node is kept in
+// the mutex, so the plain Lockable lock()/unlock() (std::scoped_lock,
+// synchronized_value) work - no node has to be passed around. Waiters
+// yield while spinning and park in detail::parking_lot after a while, so
+// oversubscription (more threads than CPUs) degrades to a fair sleeping
+// lock rather than to a convoy of spinners; note that a queue lock hands
+// the lock to the next waiter even if it is not running, which costs
+// throughput when threads outnumber CPUs.
+template<unsigned SpinLimit = 100>
+class mcs_mutex {
+    std::atomic<detail::mcs_node*> tail{nullptr};
+    detail::mcs_node* owner = nullptr;      // guarded by the lock itself
+
+    static void wait_granted(detail::mcs_node& n) {
+        for (unsigned spins = 0; spins < SpinLimit; ++spins) {
+            if (n.state.load(std::memory_order_acquire) == detail::mcs_node::granted) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        auto s = detail::mcs_node::waiting;
+        if (n.state.compare_exchange_strong(s, detail::mcs_node::parked, std::memory_order_acquire)) {
+            do {
+                detail::parking_lot::park(&n.state, [&] {
+                    return n.state.load(std::memory_order_relaxed) == detail::mcs_node::parked;
+                });
+            } while (n.state.load(std::memory_order_acquire) != detail::mcs_node::granted);
+        }
+    }
+
+    // The parking lot only hashes the address, n may be gone by the time
+    // unpark_one() runs
+    static void grant(detail::mcs_node& n) {
+        if (n.state.exchange(detail::mcs_node::granted, std::memory_order_release) == detail::mcs_node::parked) {
+            detail::parking_lot::unpark_one(&n.state, [](bool) {});
+        }
+    }
+
+public:
+    mcs_mutex() = default;
+    mcs_mutex(const mcs_mutex&) = delete;
+    mcs_mutex& operator=(const mcs_mutex&) = delete;
+
+    // Lockable
+    void lock() {
+        auto& pool = detail::mcs_node_pool::local();
+        detail::mcs_node* n = pool.get();
+        if (detail::mcs_node* pred = tail.exchange(n, std::memory_order_acq_rel)) {
+            pred->next.store(n, std::memory_order_release);
+            wait_granted(*n);
+        }
+        owner = n;
+    }
+
+    bool try_lock() {
+        auto& pool = detail::mcs_node_pool::local();
+        detail::mcs_node* n = pool.get();
+        detail::mcs_node* empty = nullptr;
+        if (!tail.compare_exchange_strong(empty, n, std::memory_order_acquire, std::memory_order_relaxed)) {
+            pool.put(n);
+            return false;
+        }
+        owner = n;
+        return true;
+    }
+
+    void unlock() {
+        detail::mcs_node* n = owner;
+        detail::mcs_node* next = n->next.load(std::memory_order_acquire);
+        if (!next) {
+            detail::mcs_node* self = n;
+            if (tail.compare_exchange_strong(self, nullptr, std::memory_order_release, std::memory_order_relaxed)) {
+                detail::mcs_node_pool::local().put(n);
+                return;
+            }
+            // a successor swapped itself in but has not linked yet
+            while (!(next = n->next.load(std::memory_order_acquire))) {
+                std::this_thread::yield();
+            }
+        }
+        grant(*next);
+        detail::mcs_node_pool::local().put(n);
+    }
+};
+
+} // namespace BM
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace BM {
+
+namespace detail {
+    // Global table of wait queues keyed by address (WebKit's ParkingLot):
+    // anything can block a thread on any address without owning a kernel
+    // object or a queue of its own. Threads parked on addresses that hash to
+    // the same bucket share its queue.
+    class parking_lot {
+        // One per thread, a thread is parked on at most one address at a time
+        struct parker {
+            std::mutex m;
+            std::condition_variable cv;
+            bool unparked = false;
+            const void* address = nullptr;
+            parker* next = nullptr;
+        };
+
+        struct alignas(cache_line_size) bucket {
+            std::mutex m;
+            parker* head = nullptr;
+            parker* tail = nullptr;
+        };
+
+        static constexpr std::size_t bucket_count = 4096;
+
+        static bucket& bucket_of(const void* address) {
+            static bucket buckets[bucket_count];
+            auto a = reinterpret_cast<std::uintptr_t>(address);
+            return buckets[(a * 0x9E3779B97F4A7C15ull) >> (64 - 12)];
+        }
+
+        static_assert(bucket_count == std::size_t{1} << 12);
+
+    public:
+        // Blocks the calling thread on address until unpark_one(address) picks
+        // it - unless validate(), run under the bucket lock, returns false.
+        // Returns whether the thread was parked.
+        template<typename Validate>
+        static bool park(const void* address, Validate&& validate) {
+            thread_local parker self;
+            bucket& b = bucket_of(address);
+            {
+                std::lock_guard l(b.m);
+                if (!validate()) {
+                    return false;
+                }
+                self.address = address;
+                self.next = nullptr;
+                self.unparked = false;
+                (b.tail ? b.tail->next : b.head) = &self;
+                b.tail = &self;
+            }
+            std::unique_lock l(self.m);
+            self.cv.wait(l, [] { return self.unparked; });
+            return true;
+        }
+
+        // Wakes the longest parked thread on address, if any. callback(more),
+        // run under the bucket lock before that thread wakes up, learns
+        // whether others stay parked on address - the place to update the
+        // state validate() looks at.
+        template<typename Callback>
+        static void unpark_one(const void* address, Callback&& callback) {
+            bucket& b = bucket_of(address);
+            parker* woken = nullptr;
+            {
+                std::lock_guard l(b.m);
+                parker* prev = nullptr;
+                for (auto* p = b.head; p; prev = p, p = p->next) {
+                    if (p->address == address) {
+                        woken = p;
+                        (prev ? prev->next : b.head) = p->next;
+                        if (b.tail == p) {
+                            b.tail = prev;
+                        }
+                        break;
+                    }
+                }
+                bool more = false;
+                for (auto* p = woken ? woken->next : nullptr; p && !more; p = p->next) {
+                    more = p->address == address;
+                }
+                callback(more);
+            }
+            if (woken) {
+                // notify with the parker's mutex held: it cannot leave park()
+                // (and go on to park elsewhere) before we are done with it
+                std::lock_guard l(woken->m);
+                woken->unparked = true;
+                woken->cv.notify_one();
+            }
+        }
+    };
+} // namespace detail
+
+// Mutex of a single byte (or any other lock-free Word) for very many values.
+//
+// Two bits: locked, and "someone may be parked". Uncontended lock()/unlock()
+// are one CAS each; contended lock() spins/yields briefly, then sets the
+// parked bit and sleeps in detail::parking_lot on the mutex's address -
+// there is no per-mutex kernel object or queue, a mutex nobody waits for
+// costs its Word and nothing else. unlock() only visits the parking lot when
+// the parked bit is set. Unfair (a running thread may barge in ahead of a
+// woken one), like std::mutex.
+//
+//   synchronized_value<long, parking_lot_mutex<>> - 16 bytes instead of 48
+template<typename Word = std::uint8_t>
+class parking_lot_mutex {
+    static_assert(std::atomic<Word>::is_always_lock_free);
+
+    static constexpr Word is_locked = 1;
+    static constexpr Word has_parked = 2;
+    static constexpr unsigned spin_limit = 40;  // as in WebKit's WTF::Lock
+
+    std::atomic<Word> state{0};
+
+    void lock_slow() {
+        for (unsigned spins = 0;;) {
+            Word s = state.load(std::memory_order_relaxed);
+            if (!(s & is_locked)) {
+                if (state.compare_exchange_weak(s, s | is_locked, std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if (!(s & has_parked)) {
+                if (spins < spin_limit) {
+                    ++spins;
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (!state.compare_exchange_weak(s, s | has_parked, std::memory_order_relaxed)) {
+                    continue;
+                }
+            }
+            detail::parking_lot::park(&state, [this] {
+                return state.load(std::memory_order_relaxed) == (is_locked | has_parked);
+            });
+        }
+    }
+
+    void unlock_slow() {
+        detail::parking_lot::unpark_one(&state, [this](bool more) {
+            state.store(more ? has_parked : 0, std::memory_order_release);
+        });
+    }
+
+public:
+    parking_lot_mutex() = default;
+    parking_lot_mutex(const parking_lot_mutex&) = delete;
+    parking_lot_mutex& operator=(const parking_lot_mutex&) = delete;
+
+    // Lockable
+    void lock() {
+        Word s = 0;
+        if (!state.compare_exchange_weak(s, is_locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+            lock_slow();
+        }
+    }
+
+    bool try_lock() {
+        Word s = state.load(std::memory_order_relaxed);
+        while (!(s & is_locked)) {
+            if (state.compare_exchange_weak(s, s | is_locked, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void unlock() {
+        Word s = is_locked;
+        if (!state.compare_exchange_strong(s, 0, std::memory_order_release, std::memory_order_relaxed)) {
+            unlock_slow();
+        }
+    }
+};
+
+} // namespace BM
@@ -0,0 +1,378 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace BM {
+
+namespace detail {
+    // Epoch-based reclamation for rcu_synchronized_value.
+    //
+    // Readers announce the global epoch in a per-thread record while they hold
+    // a snapshot - a store to their own cache line, never to a shared one.
+    // Writers retire replaced versions tagged with the current epoch; the epoch
+    // advances once every active reader has announced it, and a version retired
+    // in epoch E is freed when the global epoch reaches E + 2, by which time no
+    // reader that could have seen it is still around.
+    class epoch_domain {
+        static constexpr std::uint64_t idle = ~std::uint64_t{0};
+
+        struct alignas(cache_line_size) reader_record {
+            std::atomic<std::uint64_t> epoch{idle};
+            std::atomic<bool> in_use{true};
+            unsigned nesting = 0;
+            reader_record* next = nullptr;
+        };
+
+        struct retired_version {
+            const void* ptr;
+            void (*deleter)(const void*);
+            std::uint64_t epoch;
+        };
+
+        std::atomic<std::uint64_t> global_epoch{0};
+        std::atomic<reader_record*> records{nullptr};
+        std::mutex retired_mutex;
+        std::vector<retired_version> retired;
+
+        // Claims a record left behind by an exited thread, or adds a new one
+        reader_record* acquire_record() {
+            for (auto* r = records.load(std::memory_order_acquire); r; r = r->next) {
+                bool free = false;
+                if (r->in_use.compare_exchange_strong(free, true)) {
+                    return r;
+                }
+            }
+            auto* r = new reader_record;
+            r->next = records.load(std::memory_order_relaxed);
+            while (!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+            return r;
+        }
+
+        reader_record& local_record() {
+            struct handle {
+                reader_record* record;
+                explicit handle(epoch_domain& d) : record(d.acquire_record()) {}
+                ~handle() { record->in_use.store(false, std::memory_order_release); }
+            };
+            thread_local handle h(*this);
+            return *h.record;
+        }
+
+        // The epoch may advance once every active reader has announced it
+        bool try_advance() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto e = global_epoch.load(std::memory_order_relaxed);
+            for (auto* r = records.load(std::memory_order_acquire); r; r = r->next) {
+                auto re = r->epoch.load(std::memory_order_acquire);
+                if (re != idle && re != e) {
+                    return false;
+                }
+            }
+            global_epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst);
+            return true;
+        }
+
+        // Advancing twice is all it takes to free everything retired so far
+        void collect_locked() {
+            if (try_advance()) {
+                try_advance();
+            }
+            auto e = global_epoch.load(std::memory_order_seq_cst);
+            std::erase_if(retired, [e](const retired_version& v) {
+                if (v.epoch + 2 > e) {
+                    return false;
+                }
+                v.deleter(v.ptr);
+                return true;
+            });
+        }
+
+    public:
+        static epoch_domain& instance() {
+            static epoch_domain domain;
+            return domain;
+        }
+
+        ~epoch_domain() {
+            for (auto& v : retired) {
+                v.deleter(v.ptr);
+            }
+            for (auto* r = records.load(); r;) {
+                delete std::exchange(r, r->next);
+            }
+        }
+
+        // Read-side critical section, nests
+        void enter() {
+            reader_record& r = local_record();
+            if (r.nesting++ == 0) {
+                r.epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        void leave() {
+            reader_record& r = local_record();
+            if (--r.nesting == 0) {
+                r.epoch.store(idle, std::memory_order_release);
+            }
+        }
+
+        // Free ptr once no reader can hold it any more
+        template<typename T>
+        void retire(const T* ptr) {
+            std::lock_guard lock(retired_mutex);
+            retired.push_back({ptr, [](const void* p) { delete static_cast<const T*>(p); },
+                               global_epoch.load(std::memory_order_seq_cst)});
+            collect_locked();
+        }
+
+        // Opportunistically free what can be freed (e.g. after a burst of writes)
+        void collect() {
+            std::lock_guard lock(retired_mutex);
+            collect_locked();
+        }
+    };
+} // namespace detail
+
+template<class T, Lockable Mutex>
+class shared_rcu_synchronized_value;
+
+// Read-copy-update flavour of synchronized_value for read-mostly data.
+//
+//  - const apply() and apply() on share() are readers: they get a stable,
+//    immutable snapshot of the current version and never write to a lock word
+//  - non-const apply() is a writer: writers serialize on Mutex, f modifies a
+//    private copy which is published (atomically replacing the current version)
+//    only if f returns normally
+//  - replaced versions are freed through epoch-based reclamation, once no
+//    reader can still be looking at them
+//
+// Readers may see the previous version while a writer is busy, so values read
+// in one apply() must not be assumed current in the next one.
+template<class T, Lockable Mutex = std::mutex>
+class rcu_synchronized_value {
+public:
+    using value_type = T;
+    using mutex_type = Mutex;
+
+private:
+    std::atomic<const T*> current;
+    mutable Mutex writers;
+
+    // all adapters, including those of shared_rcu_synchronized_value views
+    template<SynchronisedValueLike SV>
+    friend class synchronized_value_lockable_adapter;
+
+public:
+    rcu_synchronized_value(const rcu_synchronized_value&) = delete;
+    rcu_synchronized_value& operator=(const rcu_synchronized_value&) = delete;
+    rcu_synchronized_value(rcu_synchronized_value&&) = delete;
+    rcu_synchronized_value& operator=(rcu_synchronized_value&&) = delete;
+
+    template<class... Args>
+    rcu_synchronized_value(Args&&... args)
+        requires (sizeof...(Args) != 1 ||
+                 (!std::same_as<rcu_synchronized_value, std::remove_cvref_t<Args>> && ...)) &&
+                 std::is_constructible_v<T, Args...>
+        : current(new T(std::forward<Args>(args)...)) {}
+
+    // No reader may be inside apply() on this value any more
+    ~rcu_synchronized_value() {
+        delete current.load(std::memory_order_relaxed);
+    }
+
+    // Read-only view, same as a const reference but mirrors synchronized_value::share()
+    auto share() & -> shared_rcu_synchronized_value<T, Mutex> {
+        return shared_rcu_synchronized_value<T, Mutex>(*this);
+    }
+
+    auto share() && = delete;
+};
+
+template<class T, Lockable Mutex>
+class shared_rcu_synchronized_value {
+public:
+    using value_type = T;
+    using mutex_type = Mutex;
+
+private:
+    const rcu_synchronized_value<T, Mutex>& rcu_val_;
+
+    explicit shared_rcu_synchronized_value(const rcu_synchronized_value<T, Mutex>& v) : rcu_val_(v) {}
+
+    friend class rcu_synchronized_value<T, Mutex>;
+
+    template<SynchronisedValueLike SV>
+    friend class synchronized_value_lockable_adapter;
+
+public:
+    shared_rcu_synchronized_value(const shared_rcu_synchronized_value&) = delete;
+    shared_rcu_synchronized_value& operator=(const shared_rcu_synchronized_value&) = delete;
+};
+
+template<typename T>
+struct is_rcu_synchronized_value : std::false_type {};
+
+template<typename T, typename M>
+struct is_rcu_synchronized_value<rcu_synchronized_value<T, M>> : std::true_type {};
+
+template<typename T, typename M>
+struct is_rcu_synchronized_value<shared_rcu_synchronized_value<T, M>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_rcu_synchronized_value_v = is_rcu_synchronized_value<std::remove_cvref_t<T>>::value;
+
+template<typename T, typename M>
+struct is_synchronized_value_like<rcu_synchronized_value<T, M>> : std::true_type {};
+
+template<typename T, typename M>
+struct is_synchronized_value_like<shared_rcu_synchronized_value<T, M>> : std::true_type {};
+
+// Readers only pin a snapshot, writers go ahead meanwhile: no apply_when() for them
+template<typename T, typename M>
+struct lock_excludes_writers<const rcu_synchronized_value<T, M>> : std::false_type {};
+
+template<typename T, typename M>
+struct lock_excludes_writers<shared_rcu_synchronized_value<T, M>> : std::false_type {};
+
+template<typename T, typename M>
+struct lock_excludes_writers<const shared_rcu_synchronized_value<T, M>> : std::false_type {};
+
+// Adapter for RCU values: a reader "lock" pins a snapshot (never blocks), a
+// writer lock takes the writer mutex and prepares a private copy to modify
+template<SynchronisedValueLike SyncValue>
+    requires is_rcu_synchronized_value_v<SyncValue>
+class synchronized_value_lockable_adapter<SyncValue> {
+private:
+    using rcu_type = rcu_synchronized_value<typename std::remove_cvref_t<SyncValue>::value_type,
+                                            typename std::remove_cvref_t<SyncValue>::mutex_type>;
+    using T = typename rcu_type::value_type;
+
+    static constexpr bool writer = std::same_as<std::remove_reference_t<SyncValue>, rcu_type>;
+
+    std::conditional_t<writer, rcu_type&, const rcu_type&> rcu;
+    const T* snapshot = nullptr;
+    std::unique_ptr<T> draft;
+
+    static auto target(rcu_type& v) -> rcu_type& { return v; }
+    static auto target(const rcu_type& v) -> const rcu_type& { return v; }
+    static auto target(const shared_rcu_synchronized_value<T, typename rcu_type::mutex_type>& v) -> const rcu_type& {
+        return v.rcu_val_;
+    }
+
+    // Writers only, with the writer mutex held
+    void prepare_draft() {
+        try {
+            draft = std::make_unique<T>(*rcu.current.load(std::memory_order_relaxed));
+        } catch (...) {
+            rcu.writers.unlock();
+            throw;
+        }
+    }
+
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
+    friend auto detail::apply_impl(F&& f, SV0&& sv0, SVs&&... svs);
+
+    template<typename F, typename... SVs>
+    friend auto detail::try_apply_impl(const detail::deadline& d, F&& f, SVs&&... svs);
+
+    template<SynchronisedValueLike SV>
+    friend auto detail::make_lockable_adapter(SV&& sv);
+
+    synchronized_value_lockable_adapter(SyncValue&& sv) : rcu(target(sv)) {}
+
+public:
+    void lock() {
+        if constexpr (writer) {
+            rcu.writers.lock();
+            prepare_draft();
+        } else {
+            detail::epoch_domain::instance().enter();
+            snapshot = rcu.current.load(std::memory_order_acquire);
+        }
+    }
+
+    void unlock() {
+        if constexpr (writer) {
+            auto unused = std::move(draft);   // f threw: dropped after the unlock
+            rcu.writers.unlock();
+        } else {
+            snapshot = nullptr;
+            detail::epoch_domain::instance().leave();
+        }
+    }
+
+    bool try_lock() {
+        if constexpr (writer) {
+            if (!rcu.writers.try_lock()) {
+                return false;
+            }
+            prepare_draft();
+            return true;
+        } else {
+            lock();
+            return true;
+        }
+    }
+
+    lock_order_key lock_order() const {
+        return {lock_rank_v<rcu_type>, reinterpret_cast<std::uintptr_t>(&rcu.writers)};
+    }
+
+    auto value() const -> auto& {
+        if constexpr (writer) {
+            return *draft;
+        } else {
+            return *snapshot;
+        }
+    }
+
+    // Retires the version it holds when destroyed
+    struct retiring {
+        const T* ptr;
+        explicit retiring(const T* p) : ptr(p) {}
+        retiring(retiring&& other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+        ~retiring() {
+            if (ptr) {
+                detail::epoch_domain::instance().retire(ptr);
+            }
+        }
+    };
+
+    // Writers only: publish the modified copy. The replaced version is
+    // retired - and whatever has expired freed, running ~T() - once the
+    // writer mutex is released, through defer_destroy(): even if the apply()
+    // fails later on, e.g. in the commit of another value.
+    void commit() requires writer {
+        auto* old = rcu.current.exchange(draft.release(), std::memory_order_acq_rel);
+        defer_destroy(retiring(old));
+    }
+};
+
+// Apply overloads with an RCU value first (see synchronized_value.hpp for why
+// the first parameter has to be spelled out)
+template<typename F, typename T0, Lockable M0, SynchronisedValueLike... SVs>
+auto apply(F&& f, rcu_synchronized_value<T0, M0>& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+}
+
+template<typename F, typename T0, Lockable M0, SynchronisedValueLike... SVs>
+auto apply(F&& f, const rcu_synchronized_value<T0, M0>& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+}
+
+template<typename F, typename T0, Lockable M0, SynchronisedValueLike... SVs>
+auto apply(F&& f, const shared_rcu_synchronized_value<T0, M0>& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+}
+
+} // namespace BM
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <atomic>
+#include <thread>
+
+namespace BM {
+
+// Sequence lock: writers serialize on Mutex and bump a sequence counter to odd
+// on lock() and back to even on unlock(). Readers never write shared memory:
+// they copy the data and retry if the sequence changed in the meantime.
+//
+// As the Mutex of a synchronized_value (T must be trivially copyable):
+//  - apply() on const values only, all of them seqlock-protected, reads
+//    optimistically and calls f with consistent copies
+//  - any other apply() locks it like a plain mutex - that includes const
+//    values mixed with other values, which makes optimistic readers retry
+template<Lockable Mutex = std::mutex>
+class seqlock {
+    std::atomic<unsigned> seq{0};
+    Mutex writers;
+
+    void begin_write() {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+public:
+    // Lockable - writers
+    void lock() {
+        writers.lock();
+        begin_write();
+    }
+
+    bool try_lock() {
+        if (!writers.try_lock()) {
+            return false;
+        }
+        begin_write();
+        return true;
+    }
+
+    void unlock() {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        writers.unlock();
+    }
+
+    // SequenceLockable - readers
+    unsigned read_begin() const {
+        unsigned s = seq.load(std::memory_order_acquire);
+        while (s & 1) {
+            std::this_thread::yield();
+            s = seq.load(std::memory_order_acquire);
+        }
+        return s;
+    }
+
+    bool read_validate(unsigned s) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq.load(std::memory_order_relaxed) == s;
+    }
+};
+
+template<class T, Lockable Mutex = std::mutex, LayoutPolicy Layout = layout::compact>
+using seqlock_synchronized_value = synchronized_value<T, seqlock<Mutex>, Layout>;
+
+} // namespace BM
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// Restartable sequences: glibc >= 2.35 registers every thread with the kernel,
+// which then keeps the current CPU number up to date in a thread-local struct
+#ifndef SV_USE_RSEQ
+#if defined(__linux__) && defined(__GLIBC__) && __has_include(<sys/rseq.h>)
+#if __GLIBC_PREREQ(2, 35)
+#define SV_USE_RSEQ 1
+#endif
+#endif
+#endif
+
+#ifndef SV_USE_RSEQ
+#define SV_USE_RSEQ 0
+#endif
+
+#if SV_USE_RSEQ
+#include <sys/rseq.h>
+#endif
+
+// Number of shards per value, 0 = one per CPU
+#ifndef SV_SHARD_COUNT
+#define SV_SHARD_COUNT 0
+#endif
+
+namespace BM {
+
+namespace detail {
+    // Shard for the calling thread: the CPU it runs on according to rseq (no
+    // syscall, a load from the thread's rseq area), else a per-thread index
+    inline unsigned current_shard_hint() {
+#if SV_USE_RSEQ
+        if (__rseq_size > 0) {
+            auto* rs = reinterpret_cast<const volatile struct rseq*>(
+                static_cast<const char*>(__builtin_thread_pointer()) + __rseq_offset);
+            auto cpu = static_cast<int>(rs->cpu_id);
+            if (cpu >= 0) {
+                return static_cast<unsigned>(cpu);
+            }
+        }
+#endif
+        return thread_index();
+    }
+} // namespace detail
+
+// Sharded value for commutative updates (counters, balances receiving deposits).
+//
+// The logical value is the Merge of all shards; there is one shard per CPU,
+// each with its own Mutex on cache line(s) of its own. update(f) applies a
+// commutative f to the calling CPU's shard only, so concurrent deposits on
+// different CPUs do not touch the same lock word or value.
+//
+//  - read_exact() locks all shards and merges them - a consistent value
+//  - read_approx() merges shards one lock at a time - never blocks updates
+//    on more than one shard, but the result need not have existed at any
+//    single instant
+//  - apply() (also together with other values, e.g. transfers) locks all
+//    shards, folds them into one and hands f that one value
+//
+// Requirements: T{} is the identity of Merge, Merge is commutative and
+// associative, i.e. the order in which updates are applied does not matter.
+//
+// rseq is only used to pick the shard, updates still take the shard lock, as
+// a thread may migrate between reading its CPU number and updating the shard.
+// The lock is then almost always uncontended and already in the local cache.
+template<class T, class Merge = std::plus<>, Lockable Mutex = std::mutex>
+class sharded_synchronized_value {
+public:
+    using value_type = T;
+    using mutex_type = Mutex;
+
+private:
+    struct alignas(cache_line_size) shard {
+        mutable Mutex mut;
+        mutable T value{};
+    };
+
+    std::size_t count;
+    std::unique_ptr<shard[]> shards;
+
+    template<SynchronisedValueLike SV>
+    friend class synchronized_value_lockable_adapter;
+
+    static std::size_t default_shard_count() {
+        if constexpr (SV_SHARD_COUNT > 0) {
+            return SV_SHARD_COUNT;
+        } else {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    // With all shards locked: move everything into shard 0
+    void fold() const {
+        for (std::size_t i = 1; i < count; ++i) {
+            shards[0].value = Merge{}(std::move(shards[0].value), std::exchange(shards[i].value, T{}));
+        }
+    }
+
+public:
+    sharded_synchronized_value(const sharded_synchronized_value&) = delete;
+    sharded_synchronized_value& operator=(const sharded_synchronized_value&) = delete;
+    sharded_synchronized_value(sharded_synchronized_value&&) = delete;
+    sharded_synchronized_value& operator=(sharded_synchronized_value&&) = delete;
+
+    // Initial value goes to shard 0, all others start as T{}
+    template<class... Args>
+    sharded_synchronized_value(Args&&... args)
+        requires (sizeof...(Args) != 1 ||
+                 (!std::same_as<sharded_synchronized_value, std::remove_cvref_t<Args>> && ...)) &&
+                 std::is_constructible_v<T, Args...>
+        : count(default_shard_count()), shards(std::make_unique<shard[]>(count)) {
+        shards[0].value = T(std::forward<Args>(args)...);
+    }
+
+    // Commutative update of the calling CPU's shard, returns what f returns
+    template<typename F>
+    auto update(F&& f) {
+        shard& s = shards[detail::current_shard_hint() % count];
+        detail::defer_scope deferred;
+        std::lock_guard lock(s.mut);
+        // apply_when() waiters wait on shard 0 and can only check the sum
+        // themselves, wake them all
+        detail::scope_exit notify([this] {
+            if (detail::wait_table::has_waiters()) {
+                detail::wait_table::notify(reinterpret_cast<std::uintptr_t>(&shards[0].mut), false);
+            }
+        });
+        return std::invoke(std::forward<F>(f), s.value);
+    }
+
+    T read_exact() const {
+        std::size_t locked = 0;
+        try {
+            for (; locked < count; ++locked) {
+                shards[locked].mut.lock();
+            }
+        } catch (...) {
+            while (locked-- > 0) {
+                shards[locked].mut.unlock();
+            }
+            throw;
+        }
+        T result{};
+        for (std::size_t i = 0; i < count; ++i) {
+            result = Merge{}(std::move(result), shards[i].value);
+        }
+        for (std::size_t i = count; i-- > 0;) {
+            shards[i].mut.unlock();
+        }
+        return result;
+    }
+
+    T read_approx() const {
+        T result{};
+        for (std::size_t i = 0; i < count; ++i) {
+            std::lock_guard lock(shards[i].mut);
+            result = Merge{}(std::move(result), shards[i].value);
+        }
+        return result;
+    }
+
+    std::size_t shard_count() const { return count; }
+};
+
+template<typename T>
+struct is_sharded_synchronized_value : std::false_type {};
+
+template<typename T, typename Merge, typename M>
+struct is_sharded_synchronized_value<sharded_synchronized_value<T, Merge, M>> : std::true_type {};
+
+template<typename T>
+constexpr bool is_sharded_synchronized_value_v = is_sharded_synchronized_value<std::remove_cvref_t<T>>::value;
+
+template<typename T, typename Merge, typename M>
+struct is_synchronized_value_like<sharded_synchronized_value<T, Merge, M>> : std::true_type {};
+
+// Adapter for sharded values: locking means locking every shard (in shard
+// order, under the order key of shard 0) and folding them into shard 0
+template<SynchronisedValueLike SyncValue>
+    requires is_sharded_synchronized_value_v<SyncValue>
+class synchronized_value_lockable_adapter<SyncValue> {
+private:
+    using sharded_type = std::remove_cvref_t<SyncValue>;
+
+    std::remove_reference_t<SyncValue>& sv;
+
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
+    friend auto detail::apply_impl(F&& f, SV0&& sv0, SVs&&... svs);
+
+    template<typename F, typename... SVs>
+    friend auto detail::try_apply_impl(const detail::deadline& d, F&& f, SVs&&... svs);
+
+    template<SynchronisedValueLike SV>
+    friend auto detail::make_lockable_adapter(SV&& sv);
+
+    synchronized_value_lockable_adapter(SyncValue&& sv) : sv(sv) {}
+
+    void unlock_first(std::size_t n) {
+        while (n-- > 0) {
+            sv.shards[n].mut.unlock();
+        }
+    }
+
+public:
+    void lock() {
+        std::size_t locked = 0;
+        try {
+            for (; locked < sv.count; ++locked) {
+                sv.shards[locked].mut.lock();
+            }
+        } catch (...) {
+            unlock_first(locked);
+            throw;
+        }
+        sv.fold();
+    }
+
+    void unlock() {
+        unlock_first(sv.count);
+    }
+
+    bool try_lock() {
+        for (std::size_t i = 0; i < sv.count; ++i) {
+            if (!sv.shards[i].mut.try_lock()) {
+                unlock_first(i);
+                return false;
+            }
+        }
+        sv.fold();
+        return true;
+    }
+
+    lock_order_key lock_order() const {
+        return {lock_rank_v<sharded_type>, reinterpret_cast<std::uintptr_t>(&sv.shards[0].mut)};
+    }
+
+    auto value() const -> auto& {
+        if constexpr (std::is_const_v<std::remove_reference_t<SyncValue>>) {
+            return std::as_const(sv.shards[0].value);
+        } else {
+            return sv.shards[0].value;
+        }
+    }
+};
+
+// Apply overloads with a sharded value first (see synchronized_value.hpp for
+// why the first parameter has to be spelled out)
+template<typename F, typename T0, typename Merge0, Lockable M0, SynchronisedValueLike... SVs>
+auto apply(F&& f, sharded_synchronized_value<T0, Merge0, M0>& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+}
+
+template<typename F, typename T0, typename Merge0, Lockable M0, SynchronisedValueLike... SVs>
+auto apply(F&& f, const sharded_synchronized_value<T0, Merge0, M0>& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+}
+
+} // namespace BM
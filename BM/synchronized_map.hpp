@@ -0,0 +1,166 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace BM {
+
+// Concurrent hash map whose entries are synchronized_values.
+//
+// Keys are spread over a power-of-two number of stripes, each an
+// unordered_map of entries behind a shared mutex of its own: lookups take
+// one stripe shared, inserts and erases one stripe exclusively, and every
+// stripe grows (rehashes) on its own - there is no map-wide lock and no
+// stop-the-world resize. The stripe lock is only held to find an entry;
+// apply() then locks just the entries involved, exactly as BM::apply()
+// locks synchronized_values (deadlock-free order, lock policies, stats):
+//
+//   synchronized_map<std::string, Account> accounts;
+//   accounts.try_emplace("alice", 100);
+//   accounts.apply([](Account& from, Account& to) { ... }, "alice", "bob");
+//
+// find() hands out the entry itself (a shared_ptr), to be used with other
+// synchronized_values in one BM::apply(). Entries stay alive while somebody
+// uses them, so an apply() racing with erase() of its key may still run on
+// the entry being erased - as if it had happened just before the erase().
+template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>,
+         Lockable Mutex = std::mutex, SharedLockable StripeMutex = std::shared_mutex>
+class synchronized_map {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using entry_type = synchronized_value<V, Mutex>;
+    using entry_ptr = std::shared_ptr<entry_type>;
+
+private:
+    using stripe_map = std::unordered_map<K, entry_ptr, Hash, KeyEqual>;
+    using stripe = synchronized_value<stripe_map, StripeMutex, layout::padded>;
+
+    template<typename>
+    using value_ref = V&;
+
+    std::size_t stripe_bits;
+    std::unique_ptr<stripe[]> stripes;
+
+    static std::size_t default_stripe_count() {
+        return 16 * std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Top bits of the (mixed) hash pick the stripe, the stripe's own buckets
+    // use the hash modulo their count, so both stay well spread
+    stripe& stripe_of(const K& key) const {
+        auto h = static_cast<std::uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+        return stripes[stripe_bits ? h >> (64 - stripe_bits) : 0];
+    }
+
+    template<typename F>
+    auto read_stripe(const K& key, F&& f) const {
+        auto view = stripe_of(key).share();
+        return BM::apply([&](const stripe_map& m) { return std::invoke(f, m); }, view);
+    }
+
+public:
+    // stripes is rounded up to a power of two
+    explicit synchronized_map(std::size_t stripes = default_stripe_count())
+        : stripe_bits(std::bit_width(std::max<std::size_t>(stripes, 1) - 1)),
+          stripes(std::make_unique<stripe[]>(std::size_t{1} << stripe_bits)) {}
+
+    synchronized_map(const synchronized_map&) = delete;
+    synchronized_map& operator=(const synchronized_map&) = delete;
+
+    // Inserts V(args...) unless key is there already; returns whether it did.
+    // The entry is built before its stripe gets locked.
+    template<class... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        auto entry = std::make_shared<entry_type>(std::forward<Args>(args)...);
+        return BM::apply([&](stripe_map& m) { return m.try_emplace(key, std::move(entry)).second; },
+                         stripe_of(key));
+    }
+
+    bool erase(const K& key) {
+        entry_ptr erased;   // destroyed after the stripe is unlocked
+        return BM::apply([&](stripe_map& m) {
+            auto it = m.find(key);
+            if (it == m.end()) {
+                return false;
+            }
+            erased = std::move(it->second);
+            m.erase(it);
+            return true;
+        }, stripe_of(key));
+    }
+
+    // The entry of key, or nullptr
+    entry_ptr find(const K& key) const {
+        return read_stripe(key, [&](const stripe_map& m) {
+            auto it = m.find(key);
+            return it == m.end() ? nullptr : it->second;
+        });
+    }
+
+    bool contains(const K& key) const {
+        return read_stripe(key, [&](const stripe_map& m) { return m.contains(key); });
+    }
+
+    // Sum over stripes, each read at a different moment
+    std::size_t size() const {
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < stripe_count(); ++i) {
+            auto view = stripes[i].share();
+            n += BM::apply([](const stripe_map& m) { return m.size(); }, view);
+        }
+        return n;
+    }
+
+    std::size_t stripe_count() const { return std::size_t{1} << stripe_bits; }
+
+    // f(value...) on the entries of keys, locked together as BM::apply() does.
+    // Returns f's result as std::optional (bool for void f), empty/false if
+    // a key is missing. The same key twice would deadlock on its own entry
+    // and throws std::invalid_argument instead.
+    template<typename F, typename... Keys>
+        requires (sizeof...(Keys) > 0) && (std::convertible_to<const Keys&, const K&> && ...)
+    auto apply(F&& f, const Keys&... keys) {
+        std::array<entry_ptr, sizeof...(Keys)> entries{find(keys)...};
+        using R = std::invoke_result_t<F, value_ref<Keys>...>;
+        using result_type = std::conditional_t<std::is_void_v<R>, bool, std::optional<R>>;
+
+        if (std::any_of(entries.begin(), entries.end(), [](const entry_ptr& e) { return !e; })) {
+            return result_type{};
+        }
+        for (std::size_t i = 1; i < entries.size(); ++i) {
+            if (std::find(entries.begin(), entries.begin() + i, entries[i]) != entries.begin() + i) {
+                throw std::invalid_argument("synchronized_map::apply: the same key more than once");
+            }
+        }
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            if constexpr (std::is_void_v<R>) {
+                BM::apply(std::forward<F>(f), *entries[I]...);
+                return true;
+            } else {
+                return result_type{BM::apply(std::forward<F>(f), *entries[I]...)};
+            }
+        }(std::index_sequence_for<Keys...>{});
+    }
+
+    // Pre-sizes every stripe for n entries in total
+    void reserve(std::size_t n) {
+        for (std::size_t i = 0; i < stripe_count(); ++i) {
+            BM::apply([&](stripe_map& m) { m.reserve(n / stripe_count() + 1); }, stripes[i]);
+        }
+    }
+};
+
+} // namespace BM
@@ -3,11 +3,58 @@
 #include <type_traits>
 #include <mutex>
 #include <functional>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <compare>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "usdt.hpp"
 
 #if SV_DEVELOPMENT
 #include <iostream>
 #endif
 
+// apply() skips locking while the process has a single thread, detected with
+// the flag behind glibc's own SINGLE_THREAD_P (glibc >= 2.32). Build with
+// -DSV_SINGLE_THREAD_ELISION=0 to always lock. Mutexes other processes may
+// hold (PTMutex<PTMutexAttr::ProcessShared>, robust ones) are always locked.
+#ifndef SV_SINGLE_THREAD_ELISION
+#if defined(__GLIBC__) && __has_include(<sys/single_threaded.h>)
+#define SV_SINGLE_THREAD_ELISION 1
+#endif
+#endif
+
+#ifndef SV_SINGLE_THREAD_ELISION
+#define SV_SINGLE_THREAD_ELISION 0
+#endif
+
+#if SV_SINGLE_THREAD_ELISION
+#include <sys/single_threaded.h>
+#endif
+
+// sv:* probes, see bpftrace/README.md
+SV_USDT_SEMAPHORE(sv, apply_enter);
+SV_USDT_SEMAPHORE(sv, apply_exit);
+SV_USDT_SEMAPHORE(sv, contend);
+SV_USDT_SEMAPHORE(sv, acquire);
+SV_USDT_SEMAPHORE(sv, release);
+SV_USDT_SEMAPHORE(sv, timeout);
+
 namespace BM {
 
 // Concepts
@@ -31,22 +78,119 @@ concept SharedLockable = Lockable<Mutex> && requires(Mutex& m) {
     std::is_same_v<decltype(m.try_lock_shared()), bool>;
 };
 
+template<typename Mutex>
+concept TimedLockable = Lockable<Mutex> && requires(Mutex& m, std::chrono::steady_clock::time_point tp,
+                                                    std::chrono::steady_clock::duration d) {
+    { m.try_lock_until(tp) } -> std::same_as<bool>;
+    { m.try_lock_for(d) } -> std::same_as<bool>;
+};
+
+// Mutexes that also let readers go lock-free (see BM/seqlock.hpp): take a
+// sequence number, read, and validate that no writer got in between
+template<typename Mutex>
+concept SequenceLockable = Lockable<Mutex> && requires(const Mutex& m, unsigned seq) {
+    { m.read_begin() } -> std::same_as<unsigned>;
+    { m.read_validate(seq) } -> std::same_as<bool>;
+};
+
+// Mutexes that can run a whole critical section on the caller's behalf, possibly
+// on another thread (see BM/flat_combining.hpp): combine(fn, arg) returns once
+// fn(arg) has run under the lock, rethrowing whatever fn threw
+template<typename Mutex>
+concept CombiningLockable = Lockable<Mutex> && requires(Mutex& m, void (*fn)(void*), void* arg) {
+    m.combine(fn, arg);
+};
+
+// Mutex that does nothing, for values that are never shared between threads
+// but go through the same apply()-based code: synchronized_value<T, null_mutex>
+// is as big as T and locking it costs nothing
+class null_mutex {
+public:
+    // Lockable
+    void lock() {}
+    void unlock() {}
+    bool try_lock() { return true; }
+
+    // SharedLockable
+    void lock_shared() {}
+    void unlock_shared() {}
+    bool try_lock_shared() { return true; }
+
+    // TimedLockable
+    template<class Clock, class Duration>
+    bool try_lock_until(const std::chrono::time_point<Clock, Duration>&) { return true; }
+
+    template<class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>&) { return true; }
+
+    template<class Clock, class Duration>
+    bool try_lock_shared_until(const std::chrono::time_point<Clock, Duration>&) { return true; }
+};
+
+// Cache line size used by the padded and split layouts. Pin it with
+// -DSV_CACHE_LINE_SIZE=N when synchronized_value is part of an ABI, as
+// std::hardware_destructive_interference_size follows -mtune/-mcpu.
+#if defined(SV_CACHE_LINE_SIZE)
+inline constexpr std::size_t cache_line_size = SV_CACHE_LINE_SIZE;
+#elif defined(__cpp_lib_hardware_interference_size)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+inline constexpr std::size_t cache_line_size = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+inline constexpr std::size_t cache_line_size = 64;
+#endif
+
+// Memory layout policies for synchronized_value
+namespace layout {
+    // value and mutex back to back, no padding - smallest footprint, but
+    // neighbouring values in an array share cache lines (false sharing)
+    struct compact {
+        static constexpr std::size_t object_align = 1;
+        static constexpr std::size_t mutex_align = 1;
+    };
+
+    // whole synchronized_value aligned and padded to a cache line - neighbours
+    // never share a line, value and its mutex still do
+    struct padded {
+        static constexpr std::size_t object_align = cache_line_size;
+        static constexpr std::size_t mutex_align = 1;
+    };
+
+    // value and mutex each on cache line(s) of their own - waiters spinning on
+    // the lock word do not keep invalidating the line the owner is writing
+    struct split {
+        static constexpr std::size_t object_align = cache_line_size;
+        static constexpr std::size_t mutex_align = cache_line_size;
+    };
+} // namespace layout
+
+template<typename L>
+concept LayoutPolicy = requires {
+    { L::object_align } -> std::convertible_to<std::size_t>;
+    { L::mutex_align } -> std::convertible_to<std::size_t>;
+};
+
 // Forward declarations
-template<class T, Lockable Mutex>
+template<class T, Lockable Mutex, LayoutPolicy Layout>
 class synchronized_value;
 
-template<class T, SharedLockable Mutex>
+template<class T, SharedLockable Mutex, LayoutPolicy Layout>
 class shared_synchronized_value;
 
 // Helper trait to check if a type is a synchronized_value or shared_synchronized_value
 template<typename T>
 struct is_synchronized_value : std::false_type {};
 
-template<typename T, typename M>
-struct is_synchronized_value<synchronized_value<T, M>> : std::true_type {};
+template<typename T, typename M, typename L>
+struct is_synchronized_value<synchronized_value<T, M, L>> : std::true_type {};
 
-template<typename T, typename M>
-struct is_synchronized_value<const synchronized_value<T, M>> : std::true_type {};
+template<typename T, typename M, typename L>
+struct is_synchronized_value<const synchronized_value<T, M, L>> : std::true_type {};
 
 template<typename T>
 constexpr bool is_synchronized_value_v = is_synchronized_value<std::remove_cvref_t<T>>::value;
@@ -54,18 +198,24 @@ constexpr bool is_synchronized_value_v = is_synchronized_value<std::remove_cvref
 template<typename T>
 struct is_shared_synchronized_value : std::false_type {};
 
-template<typename T, typename M>
-struct is_shared_synchronized_value<shared_synchronized_value<T, M>> : std::true_type {};
+template<typename T, typename M, typename L>
+struct is_shared_synchronized_value<shared_synchronized_value<T, M, L>> : std::true_type {};
 
-template<typename T, typename M>
-struct is_shared_synchronized_value<const shared_synchronized_value<T, M>> : std::true_type {};
+template<typename T, typename M, typename L>
+struct is_shared_synchronized_value<const shared_synchronized_value<T, M, L>> : std::true_type {};
 
 template<typename T>
 constexpr bool is_shared_synchronized_value_v = is_shared_synchronized_value<std::remove_cvref_t<T>>::value;
 
 
+// Everything apply() accepts. Other value flavours (BM/rcu_synchronized_value.hpp
+// etc.) specialize it next to their own synchronized_value_lockable_adapter.
+template<typename T>
+struct is_synchronized_value_like
+    : std::bool_constant<is_synchronized_value_v<T> || is_shared_synchronized_value_v<T>> {};
+
 template<typename T>
-constexpr bool is_synchronized_value_like_v = is_synchronized_value_v<T> || is_shared_synchronized_value_v<T>;
+constexpr bool is_synchronized_value_like_v = is_synchronized_value_like<std::remove_cvref_t<T>>::value;
 
 template<typename T>
 concept SynchronisedValueLike = is_synchronized_value_like_v<T>;
@@ -74,33 +224,33 @@ concept SynchronisedValueLike = is_synchronized_value_like_v<T>;
 template<typename T, typename = void>
 struct extract_value_type;
 
-template<typename T, Lockable M>
-struct extract_value_type<synchronized_value<T, M>, void> {
+template<typename T, Lockable M, LayoutPolicy L>
+struct extract_value_type<synchronized_value<T, M, L>, void> {
     using type = T&;
 };
 
-template<typename T, Lockable M>
-struct extract_value_type<const synchronized_value<T, M>, void> {
+template<typename T, Lockable M, LayoutPolicy L>
+struct extract_value_type<const synchronized_value<T, M, L>, void> {
     using type = const T&;
 };
 
-template<typename T, Lockable M>
-struct extract_value_type<synchronized_value<T, M>&, void> {
+template<typename T, Lockable M, LayoutPolicy L>
+struct extract_value_type<synchronized_value<T, M, L>&, void> {
     using type = T&;
 };
 
-template<typename T, Lockable M>
-struct extract_value_type<const synchronized_value<T, M>&, void> {
+template<typename T, Lockable M, LayoutPolicy L>
+struct extract_value_type<const synchronized_value<T, M, L>&, void> {
     using type = const T&;
 };
 
-template<typename T, Lockable M>
-struct extract_value_type<synchronized_value<T, M>&&, void> {
+template<typename T, Lockable M, LayoutPolicy L>
+struct extract_value_type<synchronized_value<T, M, L>&&, void> {
     using type = T&;
 };
 
-template<typename T, Lockable M>
-struct extract_value_type<const synchronized_value<T, M>&&, void> {
+template<typename T, Lockable M, LayoutPolicy L>
+struct extract_value_type<const synchronized_value<T, M, L>&&, void> {
     using type = const T&;
 };
 
@@ -113,43 +263,306 @@ struct extract_value_type<T, std::enable_if_t<is_shared_synchronized_value_v<T>>
 template<typename T>
 using extract_value_type_t = typename extract_value_type<std::remove_cvref_t<T>>::type;
 
+// Compile-time lock rank of a synchronized_value type, used by ordered_lock_policy.
+// Values with a lower rank are always locked before values with a higher one,
+// values of equal rank are ordered by mutex address. Specialize to rank a type:
+//   template<> struct BM::lock_rank<BM::synchronized_value<Ledger>> : std::integral_constant<int, 1> {};
+template<typename SV>
+struct lock_rank : std::integral_constant<int, 0> {};
+
+template<typename SV>
+constexpr int lock_rank_v = lock_rank<std::remove_cvref_t<SV>>::value;
+
+// Whether the lock apply() takes on a value keeps its writers out, which is
+// what apply_when() relies on to wait for it. Flavours whose readers do not
+// really lock (const rcu_synchronized_value) specialize it to false.
+template<typename SV>
+struct lock_excludes_writers : std::true_type {};
+
+template<typename SV>
+constexpr bool lock_excludes_writers_v = lock_excludes_writers<std::remove_reference_t<SV>>::value;
+
+// Position of a mutex in the total order used by ordered_lock_policy
+struct lock_order_key {
+    int rank;
+    std::uintptr_t address;
+
+    friend constexpr auto operator<=>(const lock_order_key&, const lock_order_key&) = default;
+};
+
+namespace detail {
+    // Order key of anything lockable: adapters provide their own (rank + address
+    // of the underlying mutex), everything else is ordered by its own address
+    template<Lockable L>
+    lock_order_key lock_order_of(const L& l) {
+        if constexpr (requires { { l.lock_order() } -> std::same_as<lock_order_key>; }) {
+            return l.lock_order();
+        } else {
+            return {0, reinterpret_cast<std::uintptr_t>(&l)};
+        }
+    }
+
+    // RAII guard locking all mutexes one by one in lock_order_key order.
+    // Unlike std::lock() it never backs off: a thread blocks only on a mutex
+    // ranked above everything it already holds, so no cycle can form.
+    template<Lockable... Locks>
+    class ordered_lock_guard {
+        struct entry {
+            lock_order_key key;
+            void* lockable;
+            void (*lock)(void*);
+            void (*unlock)(void*);
+        };
+
+        template<Lockable L>
+        static entry make_entry(L& l) {
+            return {
+                lock_order_of(l),
+                &l,
+                [](void* p) { static_cast<L*>(p)->lock(); },
+                [](void* p) { static_cast<L*>(p)->unlock(); },
+            };
+        }
+
+        std::array<entry, sizeof...(Locks)> order;
+
+    public:
+        explicit ordered_lock_guard(Locks&... locks) : order{make_entry(locks)...} {
+            if constexpr (sizeof...(Locks) > 1) {
+                std::sort(order.begin(), order.end(), [](const entry& a, const entry& b) {
+                    return a.key < b.key;
+                });
+            }
+            std::size_t locked = 0;
+            try {
+                for (; locked < order.size(); ++locked) {
+                    order[locked].lock(order[locked].lockable);
+                }
+            } catch (...) {
+                while (locked-- > 0) {
+                    order[locked].unlock(order[locked].lockable);
+                }
+                throw;
+            }
+        }
+
+        ~ordered_lock_guard() {
+            for (std::size_t i = order.size(); i-- > 0;) {
+                order[i].unlock(order[i].lockable);
+            }
+        }
+
+        ordered_lock_guard(const ordered_lock_guard&) = delete;
+        ordered_lock_guard& operator=(const ordered_lock_guard&) = delete;
+    };
+} // namespace detail
+
+// Lock acquisition policies for apply()
+//
+// std_lock_policy     - hands all mutexes to std::scoped_lock, i.e. std::lock()'s
+//                       lock-first, try-lock-the-rest, back-off-and-retry algorithm
+// ordered_lock_policy - sorts mutexes by lock_order_key and blocks on each in turn,
+//                       no retries, no spinning through try_lock()
+struct std_lock_policy {
+    template<Lockable... Locks>
+    using guard = std::scoped_lock<Locks...>;
+};
+
+struct ordered_lock_policy {
+    template<Lockable... Locks>
+    using guard = detail::ordered_lock_guard<Locks...>;
+};
+
+inline constexpr std_lock_policy std_lock{};
+inline constexpr ordered_lock_policy ordered_lock{};
+
+template<typename P>
+concept LockPolicy = requires {
+    typename P::template guard<std::mutex>;
+};
+
+// Policy used by apply() when none is given explicitly: std::lock(), as
+// always; -DSV_ORDERED_LOCKING=1 makes it ordered_lock_policy
+#ifndef SV_ORDERED_LOCKING
+#define SV_ORDERED_LOCKING 0
+#endif
+
+using default_lock_policy = std::conditional_t<SV_ORDERED_LOCKING, ordered_lock_policy, std_lock_policy>;
+
+namespace detail {
+    // Lock elision while the process is single-threaded.
+    //
+    // Only the one thread there is can elide locks, and it notes every mutex
+    // it skipped in a small table. A thread it starts from inside such a
+    // critical section sees the table (thread creation orders the writes
+    // before the new thread's start) and, having really locked a mutex,
+    // waits until the first thread is out of the section it skipped that
+    // mutex in. Everywhere else the table is one load of elided_count. Once
+    // a second thread has been started the process never counts as
+    // single-threaded again, and nothing new gets elided.
+    class single_thread {
+        static constexpr std::size_t slots = 8;
+
+        // Only ever written by the eliding thread, no read-modify-writes needed
+        inline static std::atomic<const void*> elided[slots]{};
+        inline static std::atomic<std::size_t> elided_count{0};
+
+        static void set_count(std::size_t n) {
+            elided_count.store(n, std::memory_order_release);
+        }
+
+    public:
+        static bool process() {
+#if SV_SINGLE_THREAD_ELISION
+            return __libc_single_threaded;
+#else
+            return false;
+#endif
+        }
+
+        // Instead of locking m: whether it could be skipped
+        static bool try_elide(const void* m) {
+            if (!process()) {
+                return false;
+            }
+            for (auto& slot : elided) {
+                if (!slot.load(std::memory_order_relaxed)) {
+                    slot.store(m, std::memory_order_relaxed);
+                    set_count(elided_count.load(std::memory_order_relaxed) + 1);
+                    return true;
+                }
+            }
+            return false;   // nested too deep, lock for real
+        }
+
+        // Instead of unlocking m after try_elide(m)
+        static void end_elided(const void* m) {
+            for (auto& slot : elided) {
+                if (slot.load(std::memory_order_relaxed) == m) {
+                    slot.store(nullptr, std::memory_order_release);
+                    break;
+                }
+            }
+            set_count(elided_count.load(std::memory_order_relaxed) - 1);
+        }
+
+        // Whether m is locked (for real) but the thread that started us may
+        // still be in a critical section of m it did not lock
+        static bool is_elided(const void* m) {
+            if (elided_count.load(std::memory_order_acquire) == 0) {
+                return false;
+            }
+            for (auto& slot : elided) {
+                if (slot.load(std::memory_order_acquire) == m) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // After locking m for real
+        static void await(const void* m) {
+            while (is_elided(m)) {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    // While a tracer is attached to sv:contend, sv:acquire or sv:timeout
+    // (BM/usdt.hpp), locks are taken with a try first, so that only a busy
+    // mutex pays for timing the wait; otherwise the mutex sees exactly what it
+    // would without probes (which matters to stats_mutex, for one)
+    inline bool lock_traced() {
+        return SV_USDT_ENABLED(sv, contend) || SV_USDT_ENABLED(sv, acquire) || SV_USDT_ENABLED(sv, timeout);
+    }
+
+    template<typename TryLock, typename Lock>
+    void traced_lock(std::uintptr_t address, bool shared, TryLock&& try_lock, Lock&& lock) {
+        if (try_lock()) {
+            SV_USDT_PROBE(sv, acquire, address, std::uint64_t{0}, shared);
+        } else {
+            SV_USDT_PROBE(sv, contend, address, shared);
+            auto t0 = usdt::now_ns();
+            lock();
+            SV_USDT_PROBE(sv, acquire, address, usdt::now_ns() - t0, shared);
+        }
+    }
+
+    // Mutexes shared with other processes (PTMutex<PTMutexAttr::ProcessShared>,
+    // robust ones): __libc_single_threaded only speaks for this process
+    template<typename Mutex>
+    constexpr bool is_process_shared_v = [] {
+        if constexpr (requires { { Mutex::process_shared } -> std::convertible_to<bool>; }) {
+            return static_cast<bool>(Mutex::process_shared);
+        } else {
+            return false;
+        }
+    }();
+
+    // Mutexes apply() may skip while single-threaded: not those also entered
+    // around lock() - by seqlock readers, by flat combining or by another
+    // process - nor those that count what they see (BM/lock_stats.hpp)
+    template<typename Mutex>
+    constexpr bool is_elidable_v = !SequenceLockable<Mutex> && !CombiningLockable<Mutex> &&
+                                   !is_process_shared_v<Mutex> &&
+                                   !requires(Mutex& m) { m.on_apply(std::size_t{1}); } &&
+                                   !std::same_as<Mutex, null_mutex>;
+} // namespace detail
+
 template<SynchronisedValueLike SyncValue>
 class synchronized_value_lockable_adapter;
 
 // Forward declarations for detail namespace functions
 namespace detail {
-    template<typename F, typename SV0, SynchronisedValueLike... SVs>
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
     auto apply_impl(F&& f, SV0&& sv0, SVs&&... svs);
 
+    struct deadline;
+
+    template<typename F, typename... SVs>
+    auto try_apply_impl(const deadline& d, F&& f, SVs&&... svs);
+
+    // Adapter factory for BM/ extensions that drive locking themselves
+    template<SynchronisedValueLike SV>
+    auto make_lockable_adapter(SV&& sv);
+
     template<typename SV>
     auto get_value_ref(SV&& sv) -> auto&;
+
+    template<typename SV>
+    auto get_mutex_ref(SV&& sv) -> auto&;
 }
 
 // Shared synchronized_value class - only available for SharedLockable mutexes
-template<class T, SharedLockable Mutex>
+template<class T, SharedLockable Mutex, LayoutPolicy Layout>
 class shared_synchronized_value {
 public:
     using value_type = T;
     using mutex_type = Mutex;
+    using layout_type = Layout;
+    using synchronized_value_type = synchronized_value<T, Mutex, Layout>;
 
 private:
-    synchronized_value<T, Mutex>& sync_val_;
+    synchronized_value_type& sync_val_;
 
-    explicit shared_synchronized_value(synchronized_value<T, Mutex>& sv) : sync_val_(sv) {
+    explicit shared_synchronized_value(synchronized_value_type& sv) : sync_val_(sv) {
 #if SV_DEVELOPMENT
         std::cout << "Created shared_synchronized_value<T> from addr = " << &sv << " at addr " << this << "\n";
 #endif
     }
 
-    friend class synchronized_value<T, Mutex>;
+    friend class synchronized_value<T, Mutex, Layout>;
     friend class synchronized_value_lockable_adapter<shared_synchronized_value>;
     friend class synchronized_value_lockable_adapter<shared_synchronized_value &>;
     friend class synchronized_value_lockable_adapter<const shared_synchronized_value &>;
 
-    // Friend declaration for detail namespace helper
+    // Friend declarations for detail namespace helpers
     template<typename SV>
     friend auto detail::get_value_ref(SV&& sv) -> auto&;
 
+    template<typename SV>
+    friend auto detail::get_mutex_ref(SV&& sv) -> auto&;
+
     // Provide access to the underlying mutex for locking
     Mutex& mut() const { return sync_val_.mut; }
 
@@ -164,27 +577,35 @@ private:
 };
 
 // The main synchronized_value class
-template<class T, Lockable Mutex = std::mutex>
+template<class T, Lockable Mutex = std::mutex, LayoutPolicy Layout = layout::compact>
 class synchronized_value {
+public:
     using value_type = T;
     using mutex_type = Mutex;
+    using layout_type = Layout;
+
+    static_assert(!SequenceLockable<Mutex> || std::is_trivially_copyable_v<T>,
+                  "optimistic readers copy the value while it may be written to, T must be trivially copyable");
 
 private:
-    T value;
-    mutable Mutex mut;
+    alignas(Layout::object_align) alignas(T) T value;
+    [[no_unique_address]] alignas(Layout::mutex_align) alignas(Mutex) mutable Mutex mut;
 
     // Friend declarations for detail namespace functions
-    template<typename F, typename SV0, SynchronisedValueLike... SVs>
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
     friend auto detail::apply_impl(F&& f, SV0&& sv0, SVs&&... svs);
 
     template<typename SV>
     friend auto detail::get_value_ref(SV&& sv) -> auto&;
 
-    friend class synchronized_value_lockable_adapter<synchronized_value<T, Mutex> &>;
-    friend class synchronized_value_lockable_adapter<const synchronized_value<T, Mutex> &>;
+    template<typename SV>
+    friend auto detail::get_mutex_ref(SV&& sv) -> auto&;
+
+    friend class synchronized_value_lockable_adapter<synchronized_value &>;
+    friend class synchronized_value_lockable_adapter<const synchronized_value &>;
 
 
-    template<class T2, SharedLockable M2>
+    template<class T2, SharedLockable M2, LayoutPolicy L2>
     friend class shared_synchronized_value;
 
 public:
@@ -214,10 +635,10 @@ public:
     // Shared access member function - only available for SharedLockable mutexes
     template<typename SMutex = Mutex>
         requires SharedLockable<SMutex> && std::same_as<SMutex, Mutex>
-    auto share() & -> shared_synchronized_value<T, SMutex>
+    auto share() & -> shared_synchronized_value<T, SMutex, Layout>
         requires SharedLockable<SMutex>
     {
-        return shared_synchronized_value<T, SMutex>(*this);
+        return shared_synchronized_value<T, SMutex, Layout>(*this);
     }
 
     // Prevent share() on temporary objects
@@ -234,18 +655,50 @@ private:
     std::reference_wrapper<std::remove_reference_t<SyncValue>> sv;
 
     // Friend declaration for detail namespace implementation
-    template<typename F, typename SV0, SynchronisedValueLike... SVs>
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
     friend auto detail::apply_impl(F&& f, SV0&& sv0, SVs&&... svs);
 
+    template<typename F, typename... SVs>
+    friend auto detail::try_apply_impl(const detail::deadline& d, F&& f, SVs&&... svs);
+
+    template<SynchronisedValueLike SV>
+    friend auto detail::make_lockable_adapter(SV&& sv);
+
     synchronized_value_lockable_adapter(SyncValue&& sv) : sv(sv) {
 #if SV_DEVELOPMENT
             std::cout << "creating synchronized_value_lockable_adapter\n";
 #endif
     }
 
-public:
-    void lock() {
-        if constexpr (is_shared_synchronized_value_v<SyncValue>) {
+    // Single-threaded process: the mutex is not touched at all (see detail::single_thread)
+    static constexpr bool elidable = detail::is_elidable_v<typename std::remove_cvref_t<SyncValue>::mutex_type>;
+    bool elided = false;
+
+    const void* mutex_address() const { return &detail::get_mutex_ref(sv.get()); }
+
+    bool elide() {
+        if constexpr (elidable) {
+            elided = detail::single_thread::try_elide(mutex_address());
+        }
+        return elided;
+    }
+
+    // After a successful try_lock*(): busy after all if the thread that
+    // started us is in a critical section of this mutex it did not lock
+    bool keep(bool locked) {
+        if constexpr (elidable) {
+            if (locked && detail::single_thread::is_elided(mutex_address())) {
+                unlock();
+                return false;
+            }
+        }
+        return locked;
+    }
+
+    static constexpr bool shared = is_shared_synchronized_value_v<SyncValue>;
+
+    void raw_lock() {
+        if constexpr (shared) {
             // shared_synchronized_value case - use shared lock
 #if SV_DEVELOPMENT
             std::cout << "callling lock_shared()\n";
@@ -260,8 +713,47 @@ public:
         }
     }
 
+    bool raw_try_lock() {
+        if constexpr (shared) {
+            // shared_synchronized_value case - use shared unlock
+#if SV_DEVELOPMENT
+            std::cout << "callling try_shared_lock()\n";
+#endif
+            return sv.get().mut().try_lock_shared();
+        } else {
+            // regular synchronized_value case - use exclusive unlock
+#if SV_DEVELOPMENT
+            std::cout << "callling try_lock()\n";
+#endif
+            return sv.get().mut.try_lock();
+        }
+    }
+
+    // Probes (BM/usdt.hpp) identify a value by its mutex address
+    std::uintptr_t probe_address() const { return reinterpret_cast<std::uintptr_t>(mutex_address()); }
+
+public:
+    void lock() {
+        if (elide()) {
+            return;
+        }
+        if (detail::lock_traced()) {
+            detail::traced_lock(probe_address(), shared, [&] { return raw_try_lock(); }, [&] { raw_lock(); });
+        } else {
+            raw_lock();
+        }
+        if constexpr (elidable) {
+            detail::single_thread::await(mutex_address());
+        }
+    }
+
     void unlock() {
-        if constexpr (is_shared_synchronized_value_v<SyncValue>) {
+        if (std::exchange(elided, false)) {
+            detail::single_thread::end_elided(mutex_address());
+            return;
+        }
+        SV_USDT_PROBE(sv, release, probe_address(), shared);
+        if constexpr (shared) {
             // shared_synchronized_value case - use shared unlock
 #if SV_DEVELOPMENT
             std::cout << "callling unlock_shared()\n";
@@ -277,18 +769,84 @@ public:
     }
 
     bool try_lock() {
+        if (elide()) {
+            return true;
+        }
+        bool locked = raw_try_lock();
+        if (locked) {
+            SV_USDT_PROBE(sv, acquire, probe_address(), std::uint64_t{0}, shared);
+        } else {
+            SV_USDT_PROBE(sv, contend, probe_address(), shared);
+        }
+        return keep(locked);
+    }
+
+    // Position in ordered_lock_policy's total order: rank of the value type,
+    // then address of the mutex (shared views sort with the value they view)
+    lock_order_key lock_order() const {
         if constexpr (is_shared_synchronized_value_v<SyncValue>) {
-            // shared_synchronized_value case - use shared unlock
-#if SV_DEVELOPMENT
-            std::cout << "callling try_shared_lock()\n";
-#endif
-            return sv.get().mut().try_lock_shared();
+            using sv_type = typename std::remove_cvref_t<SyncValue>::synchronized_value_type;
+            return {lock_rank_v<sv_type>, reinterpret_cast<std::uintptr_t>(&sv.get().mut())};
         } else {
-            // regular synchronized_value case - use exclusive unlock
-#if SV_DEVELOPMENT
-            std::cout << "callling try_lock()\n";
-#endif
-            return sv.get().mut.try_lock();
+            return {lock_rank_v<SyncValue>, reinterpret_cast<std::uintptr_t>(&sv.get().mut)};
+        }
+    }
+
+    // Reference handed to the apply() callback, valid while locked
+    auto value() const -> auto& {
+        return detail::get_value_ref(sv.get());
+    }
+
+    // Mutex can wait with a deadline (try_apply(), apply_for(), apply_until())
+    static constexpr bool timed = [] {
+        using M = typename std::remove_cvref_t<SyncValue>::mutex_type;
+        if constexpr (is_shared_synchronized_value_v<SyncValue>) {
+            return requires(M& m, std::chrono::steady_clock::time_point tp) {
+                { m.try_lock_shared_until(tp) } -> std::same_as<bool>;
+            };
+        } else {
+            return TimedLockable<M>;
+        }
+    }();
+
+    bool try_lock_until(std::chrono::steady_clock::time_point deadline) requires timed {
+        if (elide()) {
+            return true;
+        }
+        if (!detail::lock_traced()) {
+            return keep(raw_try_lock_until(deadline));
+        }
+        if (raw_try_lock()) {
+            SV_USDT_PROBE(sv, acquire, probe_address(), std::uint64_t{0}, shared);
+            return keep(true);
+        }
+        SV_USDT_PROBE(sv, contend, probe_address(), shared);
+        auto t0 = usdt::now_ns();
+        bool locked = raw_try_lock_until(deadline);
+        if (locked) {
+            SV_USDT_PROBE(sv, acquire, probe_address(), usdt::now_ns() - t0, shared);
+        } else {
+            SV_USDT_PROBE(sv, timeout, probe_address(), usdt::now_ns() - t0, shared);
+        }
+        return keep(locked);
+    }
+
+private:
+    bool raw_try_lock_until(std::chrono::steady_clock::time_point deadline) requires timed {
+        if constexpr (shared) {
+            return sv.get().mut().try_lock_shared_until(deadline);
+        } else {
+            return sv.get().mut.try_lock_until(deadline);
+        }
+    }
+
+public:
+
+    // Lets instrumented mutexes (BM/lock_stats.hpp) see every apply() they take part in
+    void on_apply(std::size_t arity) {
+        auto& m = detail::get_mutex_ref(sv.get());
+        if constexpr (requires { m.on_apply(arity); }) {
+            m.on_apply(arity);
         }
     }
 };
@@ -311,55 +869,848 @@ namespace detail {
         }
     }
 
+    // Helper to reach the mutex guarding any synchronized value type, for
+    // BM/ extensions that need to talk to their own mutex types
+    template<typename SV>
+    auto get_mutex_ref(SV&& sv) -> auto& {
+        using T = std::remove_cvref_t<SV>;
+        if constexpr (is_shared_synchronized_value_v<T>) {
+            return sv.mut();
+        } else {
+            return sv.mut;
+        }
+    }
+
+    template<SynchronisedValueLike SV>
+    auto make_lockable_adapter(SV&& sv) {
+        return synchronized_value_lockable_adapter<SV>(std::forward<SV>(sv));
+    }
+
+    // sv:apply_enter / sv:apply_exit (BM/usdt.hpp) around one apply(), with
+    // the first value's lock address and the arity; exit fires once all locks
+    // are released, before deferred actions run
+    struct apply_probe {
+#if SV_USDT
+        std::uintptr_t address;
+        std::size_t arity;
+
+        apply_probe(std::uintptr_t address, std::size_t arity) : address(address), arity(arity) {
+            SV_USDT_PROBE(sv, apply_enter, address, arity);
+        }
+
+        ~apply_probe() { SV_USDT_PROBE(sv, apply_exit, address, arity); }
+#else
+        apply_probe(std::uintptr_t, std::size_t) {}
+#endif
+
+        template<typename SV0, typename... SVs>
+        static std::uintptr_t address_of(SV0& sv0, SVs&...) {
+            return lock_order_of(make_lockable_adapter(sv0)).address;
+        }
+
+        apply_probe(const apply_probe&) = delete;
+        apply_probe& operator=(const apply_probe&) = delete;
+    };
+
+    // Threads blocked in apply_when(), keyed by the lock_order_key address of
+    // every value they wait for (a value's mutex, whatever flavour it is).
+    //
+    // A waiter enlists while it still holds the locks of all its values and
+    // writers notify before they unlock theirs, so no change can slip in
+    // between a waiter's check and its enlisting. Writers holding the lock
+    // re-check single-value waiters' predicates themselves and wake only the
+    // first one (in arrival order) that is satisfied now; that one passes the
+    // wake-up on when its own apply_when() is done, so no herd of waiters
+    // wakes to find the condition gone again. Waiters for several values, and
+    // notifications from writers that already unlocked, wake everybody.
+    class wait_table {
+    public:
+        struct waiter;
+
+        // One per value a waiter waits for
+        struct link {
+            std::uintptr_t key = 0;
+            waiter* owner = nullptr;
+            link* prev = nullptr;
+            link* next = nullptr;
+        };
+
+        struct waiter {
+            std::mutex m;
+            std::condition_variable cv;
+            bool woken = false;                     // guarded by m
+            std::atomic<bool> notified{false};      // written under a bucket lock
+            bool (*ready)(void*) = nullptr;         // predicate, for the writer to re-check
+            void* context = nullptr;
+        };
+
+    private:
+        struct alignas(cache_line_size) bucket {
+            std::mutex m;
+            link* head = nullptr;
+            link* tail = nullptr;
+        };
+
+        static constexpr std::size_t bucket_count = 1024;
+
+        static bucket& bucket_of(std::uintptr_t key) {
+            static bucket buckets[bucket_count];
+            return buckets[(key * 0x9E3779B97F4A7C15ull) >> (64 - 10)];
+        }
+
+        static_assert(bucket_count == std::size_t{1} << 10);
+
+        // Enlisted waiters anywhere - all a writer looks at while nobody waits
+        inline static std::atomic<std::size_t> waiting{0};
+
+        // With the bucket lock held
+        static void wake(waiter& w) {
+            w.notified.store(true, std::memory_order_relaxed);
+            std::lock_guard l(w.m);
+            w.woken = true;
+            w.cv.notify_one();
+        }
+
+        static bool satisfied(const waiter& w) {
+            try {
+                return w.ready(w.context);
+            } catch (...) {
+                return true;    // let the waiter find out itself
+            }
+        }
+
+    public:
+        static bool has_waiters() { return waiting.load(std::memory_order_relaxed) != 0; }
+
+        // With the locks of all keys held
+        static void enlist(waiter& w, std::span<link> links) {
+            waiting.fetch_add(1, std::memory_order_relaxed);
+            for (link& l : links) {
+                l.owner = &w;
+                bucket& b = bucket_of(l.key);
+                std::lock_guard g(b.m);
+                l.prev = b.tail;
+                l.next = nullptr;
+                (b.tail ? b.tail->next : b.head) = &l;
+                b.tail = &l;
+            }
+        }
+
+        // Blocks until notified, then leaves every bucket again
+        static void wait(waiter& w, std::span<link> links) {
+            {
+                std::unique_lock l(w.m);
+                w.cv.wait(l, [&] { return w.woken; });
+            }
+            for (link& l : links) {
+                bucket& b = bucket_of(l.key);
+                std::lock_guard g(b.m);
+                (l.prev ? l.prev->next : b.head) = l.next;
+                (l.next ? l.next->prev : b.tail) = l.prev;
+            }
+            waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // The value at key may have changed. locked: the caller still holds
+        // its lock exclusively, so predicates of the value may be evaluated.
+        static void notify(std::uintptr_t key, bool locked) {
+            bucket& b = bucket_of(key);
+            std::lock_guard g(b.m);
+            bool handed_over = false;
+            for (link* l = b.head; l; l = l->next) {
+                waiter& w = *l->owner;
+                if (l->key != key || w.notified.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                if (locked && w.ready) {
+                    if (handed_over || !satisfied(w)) {
+                        continue;
+                    }
+                    handed_over = true;
+                }
+                wake(w);
+            }
+        }
+    };
+
+    // Runs f when the scope is left, however that happens
+    template<typename F>
+    class scope_exit {
+        F f;
+
+    public:
+        explicit scope_exit(F f) : f(std::move(f)) {}
+        ~scope_exit() { f(); }
+
+        scope_exit(const scope_exit&) = delete;
+        scope_exit& operator=(const scope_exit&) = delete;
+    };
+
+    // What BM::defer() collects while f runs. Opened by every apply() before
+    // it locks anything; the outermost one on the thread owns the list and
+    // runs it, in order, when it goes out of scope - after all locks are
+    // released. If f exits with an exception, what it deferred is dropped:
+    // destroyed, still outside the locks of the outermost apply(), not run.
+    class defer_scope {
+        struct action {
+            int exceptions = std::uncaught_exceptions();   // in flight when deferred
+            virtual ~action() = default;
+            virtual void run() = 0;
+        };
+
+        template<typename F>
+        struct action_of final : action {
+            F f;
+            explicit action_of(F&& f) : f(std::move(f)) {}
+            void run() override { std::invoke(f); }
+        };
+
+        using action_list = std::vector<std::unique_ptr<action>>;
+
+        inline static thread_local action_list* active = nullptr;
+
+        action_list own;
+        std::size_t mark;
+
+    public:
+        defer_scope() : mark(active ? active->size() : 0) {
+            if (!active) {
+                active = &own;
+            }
+        }
+
+        // Actions run here may apply() and defer() again, in a list of their own
+        // (std::uncaught_exceptions() is not free, so it is only asked when
+        // something was deferred, and compared with the count back then)
+        ~defer_scope() {
+            if (active->size() > mark && std::uncaught_exceptions() > (*active)[mark]->exceptions) {
+                discard();
+            }
+            if (active == &own) {
+                active = nullptr;
+                for (auto& a : own) {
+                    a->run();
+                }
+            }
+        }
+
+        defer_scope(const defer_scope&) = delete;
+        defer_scope& operator=(const defer_scope&) = delete;
+
+        // Drops what was deferred since this scope was opened, e.g. by an
+        // attempt that is going to be retried
+        void discard() {
+            active->erase(active->begin() + static_cast<std::ptrdiff_t>(mark), active->end());
+        }
+
+        static bool open() { return active != nullptr; }
+
+        // What f run on behalf of another thread (flat combining) deferred:
+        // collect() on the thread running f, adopt() on the one that asked
+        // for it, once f has returned there. Left unadopted if f throws, and
+        // destroyed with the batch.
+        class batch {
+            action_list actions;
+            friend class defer_scope;
+        };
+
+        template<typename F>
+        static void collect(batch& into, F&& f) {
+            action_list* outer = std::exchange(active, &into.actions);
+            scope_exit restore([&] { active = outer; });
+            std::invoke(std::forward<F>(f));
+        }
+
+        // Into this thread's open scope, as if deferred here and now
+        static void adopt(batch& from) {
+            for (auto& a : from.actions) {
+                a->exceptions = std::uncaught_exceptions();
+                active->push_back(std::move(a));
+            }
+            from.actions.clear();
+        }
+
+        template<typename F>
+        static void add(F&& f) {
+            active->push_back(std::make_unique<action_of<std::decay_t<F>>>(std::forward<F>(f)));
+        }
+    };
+
+    // With the adapters still locked: wakes waiters for the values f had
+    // mutable access to (Mutable) - or for the read-only ones, to pass a
+    // wake-up on to the next waiter
+    template<bool Mutable, typename... Adapters>
+    void notify_waiters(Adapters&... adapters) {
+        if (!wait_table::has_waiters()) {
+            return;
+        }
+        ([&] {
+            if constexpr (Mutable != std::is_const_v<std::remove_reference_t<decltype(adapters.value())>>) {
+                wait_table::notify(lock_order_of(adapters).address, true);
+            }
+        }(), ...);
+    }
+
+    // Adapters that work on a private copy (e.g. RCU writers) publish it in
+    // commit(), called only if f returned normally, before anything is unlocked
+    template<typename Adapter>
+    concept Committing = requires(Adapter& a) { a.commit(); };
+
+    // f(values...) with the adapters locked, then commit() and wake up
+    // apply_when() waiters whose values f had mutable access to
+    template<typename F, typename... Adapters>
+    auto invoke_and_commit(F&& f, Adapters&... adapters) {
+        scope_exit notify([&] { notify_waiters<true>(adapters...); });
+        if constexpr (!(Committing<Adapters> || ...)) {
+            return std::invoke(std::forward<F>(f), adapters.value()...);
+        } else {
+            auto commit_all = [&] {
+                ([&] {
+                    if constexpr (Committing<Adapters>) {
+                        adapters.commit();
+                    }
+                }(), ...);
+            };
+            if constexpr (std::is_void_v<std::invoke_result_t<F, decltype(adapters.value())...>>) {
+                std::invoke(std::forward<F>(f), adapters.value()...);
+                commit_all();
+            } else {
+                auto result = std::invoke(std::forward<F>(f), adapters.value()...);
+                commit_all();
+                return result;
+            }
+        }
+    }
+
+    // Small per-thread index, e.g. to spread threads over slots or counter shards
+    inline unsigned thread_index() {
+        static std::atomic<unsigned> next{0};
+        thread_local unsigned index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    // Single synchronized_value with a CombiningLockable mutex - hand f over to
+    // whichever thread is running critical sections for everybody
+    template<typename SV>
+    constexpr bool is_combining_v = [] {
+        using T = std::remove_cvref_t<SV>;
+        if constexpr (is_synchronized_value_v<T>) {
+            return CombiningLockable<typename T::mutex_type>;
+        } else {
+            return false;
+        }
+    }();
+
+    // Type-erased f(value) for CombiningLockable::combine(), the result (if
+    // any) is written into this thread's stack frame by whoever runs it, and
+    // so is what f BM::defer()red - run by this thread's apply(), as usual.
+    // Needs an open defer_scope on this thread.
+    template<CombiningLockable Mutex, typename F, typename V>
+    auto combined_invoke(Mutex& m, F&& f, V& value) {
+        using R = std::invoke_result_t<F, V&>;
+        defer_scope::batch deferred;
+        if constexpr (std::is_void_v<R>) {
+            auto call = [&] {
+                defer_scope::collect(deferred, [&] { std::invoke(std::forward<F>(f), value); });
+            };
+            m.combine([](void* c) { (*static_cast<decltype(call)*>(c))(); }, &call);
+            defer_scope::adopt(deferred);
+        } else {
+            std::optional<std::decay_t<R>> result;
+            auto call = [&] {
+                defer_scope::collect(deferred, [&] { result.emplace(std::invoke(std::forward<F>(f), value)); });
+            };
+            m.combine([](void* c) { (*static_cast<decltype(call)*>(c))(); }, &call);
+            defer_scope::adopt(deferred);
+            return std::move(*result);
+        }
+    }
+
+    // const synchronized_value with a SequenceLockable mutex - read without locking
+    template<typename SV>
+    constexpr bool is_optimistic_read_v = [] {
+        using T = std::remove_reference_t<SV>;
+        if constexpr (is_synchronized_value_v<T> && std::is_const_v<T>) {
+            return SequenceLockable<typename T::mutex_type>;
+        } else {
+            return false;
+        }
+    }();
+
+    // Raw bytes of a value that may be concurrently written to. The copy may be
+    // torn; it only becomes a T after the sequence numbers have been validated.
+    template<typename T>
+    struct racy_copy {
+        std::array<std::byte, sizeof(T)> bytes;
+
+        explicit racy_copy(const T& value) {
+            std::memcpy(bytes.data(), &value, sizeof(T));
+        }
+
+        T get() const { return std::bit_cast<T>(bytes); }
+    };
+
+    // When deadline-bounded locking gives up: at `until`, or once `stop` is requested
+    struct deadline {
+        std::chrono::steady_clock::time_point until;
+        std::stop_token stop;
+
+        template<class Clock, class Duration>
+        static std::chrono::steady_clock::time_point steady(const std::chrono::time_point<Clock, Duration>& tp) {
+            if constexpr (std::is_same_v<Clock, std::chrono::steady_clock>) {
+                return std::chrono::time_point_cast<std::chrono::steady_clock::duration>(tp);
+            } else {
+                return std::chrono::steady_clock::now() +
+                       std::chrono::duration_cast<std::chrono::steady_clock::duration>(tp - Clock::now());
+            }
+        }
+    };
+
+    // Lock l before d runs out. Timed mutexes block in try_lock_until() (in
+    // short slices when the wait can be cancelled), others are polled.
+    template<Lockable L>
+    bool lock_until(L& l, const deadline& d) {
+        using namespace std::chrono;
+        constexpr auto stop_check_interval = milliseconds(1);
+        for (unsigned attempt = 0;; ++attempt) {
+            if (d.stop.stop_requested()) {
+                return false;
+            }
+            auto now = steady_clock::now();
+            if constexpr (requires { l.try_lock_until(d.until); }) {
+                auto until = d.stop.stop_possible() && d.until - now > stop_check_interval
+                           ? now + stop_check_interval : d.until;
+                if (l.try_lock_until(until)) {
+                    return true;
+                }
+            } else {
+                if (l.try_lock()) {
+                    return true;
+                }
+                if (now < d.until) {
+                    if (attempt < 16) {
+                        std::this_thread::yield();
+                    } else {
+                        std::this_thread::sleep_for(std::min<steady_clock::duration>(d.until - now, microseconds(50)));
+                    }
+                }
+            }
+            if (steady_clock::now() >= d.until) {
+                return false;
+            }
+        }
+    }
+
+    // Like ordered_lock_guard, but each lock may give up at the deadline -
+    // then everything locked so far is released again (all-or-nothing)
+    template<Lockable... Locks>
+    class ordered_deadline_lock_guard {
+        struct entry {
+            lock_order_key key;
+            void* lockable;
+            bool (*lock)(void*, const deadline&);
+            void (*unlock)(void*);
+        };
+
+        template<Lockable L>
+        static entry make_entry(L& l) {
+            return {
+                lock_order_of(l),
+                &l,
+                [](void* p, const deadline& d) { return lock_until(*static_cast<L*>(p), d); },
+                [](void* p) { static_cast<L*>(p)->unlock(); },
+            };
+        }
+
+        std::array<entry, sizeof...(Locks)> order;
+        std::size_t locked = 0;
+
+        void unlock_all() {
+            while (locked > 0) {
+                --locked;
+                order[locked].unlock(order[locked].lockable);
+            }
+        }
+
+    public:
+        explicit ordered_deadline_lock_guard(const deadline& d, Locks&... locks) : order{make_entry(locks)...} {
+            if constexpr (sizeof...(Locks) > 1) {
+                std::sort(order.begin(), order.end(), [](const entry& a, const entry& b) {
+                    return a.key < b.key;
+                });
+            }
+            try {
+                while (locked < order.size() && order[locked].lock(order[locked].lockable, d)) {
+                    ++locked;
+                }
+            } catch (...) {
+                unlock_all();
+                throw;
+            }
+            if (!owns_locks()) {
+                unlock_all();
+            }
+        }
+
+        ~ordered_deadline_lock_guard() { unlock_all(); }
+
+        bool owns_locks() const { return locked == order.size(); }
+
+        ordered_deadline_lock_guard(const ordered_deadline_lock_guard&) = delete;
+        ordered_deadline_lock_guard& operator=(const ordered_deadline_lock_guard&) = delete;
+    };
+
+    // Deadline-bounded apply: f's result in an optional (bool for void f), empty
+    // if the values could not all be locked in time. Always takes the locks, the
+    // seqlock and flat-combining shortcuts of apply_impl() could wait unbounded.
+    template<typename F, typename... SVs>
+    auto try_apply_impl(const deadline& d, F&& f, SVs&&... svs)
+    {
+        defer_scope deferred;
+        apply_probe probe(apply_probe::address_of(svs...), sizeof...(SVs));
+        auto adapters = std::tuple{synchronized_value_lockable_adapter(std::forward<SVs>(svs))...};
+
+        return std::apply([&]<typename... Locks>(Locks&... locks) {
+            using R = decltype(invoke_and_commit(std::forward<F>(f), locks...));
+            using result_type = std::conditional_t<std::is_void_v<R>, bool, std::optional<R>>;
+            ([&] {
+                if constexpr (requires { locks.on_apply(sizeof...(Locks)); }) {
+                    locks.on_apply(sizeof...(Locks));
+                }
+            }(), ...);
+            ordered_deadline_lock_guard<Locks...> lock(d, locks...);
+            if (!lock.owns_locks()) {
+                return result_type{};
+            }
+            if constexpr (std::is_void_v<R>) {
+                invoke_and_commit(std::forward<F>(f), locks...);
+                return true;
+            } else {
+                return result_type{invoke_and_commit(std::forward<F>(f), locks...)};
+            }
+        }, adapters);
+    }
+
+    // Blocks until pred holds for the locked values, enlisted in wait_table
+    // in between, then runs f under the same locks. A waiter for a single
+    // plain/shared synchronized_value lets writers re-check pred for it.
+    template<typename Pred, typename F, typename... SVs>
+    auto apply_when_impl(Pred&& pred, F&& f, SVs&&... svs)
+    {
+        defer_scope deferred;
+        apply_probe probe(apply_probe::address_of(svs...), sizeof...(SVs));
+        auto adapters = std::tuple{make_lockable_adapter(std::forward<SVs>(svs))...};
+
+        return std::apply([&]<typename... Locks>(Locks&... locks) {
+            auto check = [&] { return static_cast<bool>(std::invoke(pred, std::as_const(locks.value())...)); };
+            constexpr bool writers_may_check =
+                sizeof...(SVs) == 1 && ((is_synchronized_value_v<SVs> || is_shared_synchronized_value_v<SVs>) && ...);
+
+            for (;;) {
+                wait_table::waiter w;
+                if constexpr (writers_may_check) {
+                    w.ready = [](void* c) { return (*static_cast<decltype(check)*>(c))(); };
+                    w.context = &check;
+                }
+                std::array<wait_table::link, sizeof...(Locks)> links{wait_table::link{lock_order_of(locks).address}...};
+                {
+                    ([&] {
+                        if constexpr (requires { locks.on_apply(sizeof...(Locks)); }) {
+                            locks.on_apply(sizeof...(Locks));
+                        }
+                    }(), ...);
+                    typename default_lock_policy::template guard<Locks...> lock(locks...);
+                    if (check()) {
+                        // invoke_and_commit() notifies for what f may change
+                        scope_exit pass_on([&] { notify_waiters<false>(locks...); });
+                        return invoke_and_commit(std::forward<F>(f), locks...);
+                    }
+                    wait_table::enlist(w, links);
+                }
+                wait_table::wait(w, links);
+            }
+        }, adapters);
+    }
+
     // Unified apply implementation - handles all synchronized value types
-    template<typename F, typename SV0, SynchronisedValueLike... SVs>
+    template<LockPolicy Policy, typename F, typename SV0, SynchronisedValueLike... SVs>
     auto apply_impl(F&& f, SV0&& sv0, SVs&&... svs)
     {
-        // Create lockable adapters for all parameters
-        auto adapters = std::tuple{
-            synchronized_value_lockable_adapter(std::forward<SV0>(sv0)),
-            synchronized_value_lockable_adapter(std::forward<SVs>(svs))...
+        // BM::defer()red actions run when this goes out of scope, after the
+        // locks below - on this thread even if flat combining ran f elsewhere
+        defer_scope deferred;
+        apply_probe probe(apply_probe::address_of(sv0, svs...), 1 + sizeof...(SVs));
+
+        // All values are const and seqlock-protected: copy them optimistically,
+        // retry until no writer intervened, then call f on the consistent copies
+        if constexpr ((is_optimistic_read_v<SV0> && ... && is_optimistic_read_v<SVs>)) {
+            for (;;) {
+                auto seqs = std::array{sv0.mut.read_begin(), svs.mut.read_begin()...};
+                auto bytes = std::tuple{racy_copy(sv0.value), racy_copy(svs.value)...};
+                auto seq = seqs.begin();
+                if (sv0.mut.read_validate(*seq++) && (svs.mut.read_validate(*seq++) && ...)) {
+                    return std::apply([&](const auto&... b) {
+                        const auto copies = std::tuple{b.get()...};
+                        return std::apply(std::forward<F>(f), copies);
+                    }, bytes);
+                }
+            }
+        } else if constexpr (sizeof...(SVs) == 0 && is_combining_v<SV0>) {
+            if constexpr (std::is_const_v<std::remove_reference_t<SV0>>) {
+                return combined_invoke(sv0.mut, std::forward<F>(f), sv0.value);
+            } else {
+                // whoever runs f holds the lock, apply_when() waiters get
+                // notified right there
+                return combined_invoke(sv0.mut, [&](auto& value) -> decltype(auto) {
+                    scope_exit notify([&] {
+                        if (wait_table::has_waiters()) {
+                            wait_table::notify(reinterpret_cast<std::uintptr_t>(&sv0.mut), true);
+                        }
+                    });
+                    return std::invoke(std::forward<F>(f), value);
+                }, sv0.value);
+            }
+        } else {
+            // Create lockable adapters for all parameters
+            auto adapters = std::tuple{
+                synchronized_value_lockable_adapter(std::forward<SV0>(sv0)),
+                synchronized_value_lockable_adapter(std::forward<SVs>(svs))...
+            };
+
+            // Lock all mutexes (as the policy sees fit) and invoke function
+            return std::apply([&]<typename... Locks>(Locks&... locks) {
+                ([&] {
+                    if constexpr (requires { locks.on_apply(sizeof...(Locks)); }) {
+                        locks.on_apply(sizeof...(Locks));
+                    }
+                }(), ...);
+                typename Policy::template guard<Locks...> lock(locks...);
+                return invoke_and_commit(std::forward<F>(f), locks...);
+            }, adapters);
+        }
+    }
+
+    // Locks a runtime set of distinct synchronized_values in lock_order_key
+    // order (the same total order ordered_lock_policy uses), unlocks in reverse;
+    // through their adapters, like any other apply()
+    template<typename SV>
+    class span_lock_guard {
+        using adapter = decltype(make_lockable_adapter(std::declval<SV&>()));
+        std::vector<adapter> locks;
+
+    public:
+        explicit span_lock_guard(std::span<SV* const> sorted) {
+            locks.reserve(sorted.size());
+            for (SV* sv : sorted) {
+                locks.push_back(make_lockable_adapter(*sv));
+            }
+            std::size_t locked = 0;
+            try {
+                for (; locked < locks.size(); ++locked) {
+                    locks[locked].lock();
+                }
+            } catch (...) {
+                while (locked-- > 0) {
+                    locks[locked].unlock();
+                }
+                throw;
+            }
+        }
+
+        ~span_lock_guard() {
+            for (std::size_t i = locks.size(); i-- > 0;) {
+                locks[i].unlock();
+            }
+        }
+
+        span_lock_guard(const span_lock_guard&) = delete;
+        span_lock_guard& operator=(const span_lock_guard&) = delete;
+    };
+
+    // apply() over a runtime set of values: duplicates are dropped, each distinct
+    // mutex is locked once, f gets the distinct values in order of first occurrence
+    template<typename F, typename SV>
+    auto apply_span_impl(F&& f, std::span<SV* const> svs) {
+        using V = std::conditional_t<std::is_const_v<SV>, const typename SV::value_type, typename SV::value_type>;
+        auto key = [](const SV* sv) {
+            return lock_order_key{lock_rank_v<SV>, reinterpret_cast<std::uintptr_t>(&get_mutex_ref(*sv))};
         };
 
-        // Lock all mutexes and invoke function
-        return std::apply([&](auto&... locks) {
-            std::scoped_lock lock(locks...);
-            return std::invoke(std::forward<F>(f),
-                              get_value_ref(std::forward<SV0>(sv0)),
-                              get_value_ref(std::forward<SVs>(svs))...);
-        }, adapters);
+        defer_scope deferred;
+        std::vector<SV*> order(svs.begin(), svs.end());
+        std::sort(order.begin(), order.end(), [&](const SV* a, const SV* b) { return key(a) < key(b); });
+        order.erase(std::unique(order.begin(), order.end()), order.end());
+        apply_probe probe(order.empty() ? 0 : key(order.front()).address, order.size());
+
+        std::vector<bool> seen(order.size());
+        std::vector<std::reference_wrapper<V>> values;
+        values.reserve(order.size());
+        for (SV* sv : svs) {
+            auto pos = std::lower_bound(order.begin(), order.end(), sv,
+                                        [&](const SV* a, const SV* b) { return key(a) < key(b); });
+            if (!seen[pos - order.begin()]) {
+                seen[pos - order.begin()] = true;
+                values.emplace_back(get_value_ref(*sv));
+            }
+        }
+
+        for (SV* sv : order) {
+            auto& m = get_mutex_ref(*sv);
+            if constexpr (requires { m.on_apply(order.size()); }) {
+                m.on_apply(order.size());
+            }
+        }
+        span_lock_guard<SV> lock(order);
+        scope_exit notify([&] {
+            if constexpr (!std::is_const_v<SV>) {
+                if (wait_table::has_waiters()) {
+                    for (SV* sv : order) {
+                        wait_table::notify(key(sv).address, true);
+                    }
+                }
+            }
+        });
+        return std::invoke(std::forward<F>(f), std::span<const std::reference_wrapper<V>>(values));
     }
 } // namespace detail
 
+// Runs action once the apply() whose f calls this has released all its locks
+// (the outermost one, when apply()s nest), after what was deferred before it:
+//   apply([&](Account& a) {
+//       a.balance -= amount;
+//       BM::defer([id = a.id, amount] { audit_log(id, -amount); });
+//   }, alice);
+// Dropped if f exits with an exception. Outside apply() it runs right away.
+// The action must not throw, it runs from a destructor.
+template<typename F>
+    requires std::invocable<std::decay_t<F>&>
+void defer(F&& action)
+{
+    if (detail::defer_scope::open()) {
+        detail::defer_scope::add(std::forward<F>(action));
+    } else {
+        std::invoke(action);
+    }
+}
+
+// Destroys value after the locks are released instead of in f, e.g. a replaced
+// std::string's buffer:
+//   BM::defer_destroy(std::exchange(a.owner_name, std::move(new_name)));
+template<typename T>
+    requires (!std::is_lvalue_reference_v<T>) && std::move_constructible<T>
+void defer_destroy(T&& value)
+{
+    defer([v = std::move(value)] { (void)v; });
+}
+
 // Public apply overloads - thin wrappers with explicit first parameter types
 // These explicit overloads are necessary to avoid ambiguity with std::apply from <tuple>
 
 // Apply overload 1: First parameter is synchronized_value (lvalue reference)
-template<typename F, typename T0, Lockable M0, SynchronisedValueLike... SVs>
-auto apply(F&& f, synchronized_value<T0, M0>& sv0, SVs&&... svs)
+template<typename F, typename T0, Lockable M0, LayoutPolicy L0, SynchronisedValueLike... SVs>
+auto apply(F&& f, synchronized_value<T0, M0, L0>& sv0, SVs&&... svs)
 {
-    return detail::apply_impl(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
 }
 
 // Apply overload 2: First parameter is shared_synchronized_value (lvalue reference)
-template<typename F, typename T0, SharedLockable M0, SynchronisedValueLike... SVs>
-auto apply(F&& f, shared_synchronized_value<T0, M0>& sv0, SVs&&... svs)
+template<typename F, typename T0, SharedLockable M0, LayoutPolicy L0, SynchronisedValueLike... SVs>
+auto apply(F&& f, shared_synchronized_value<T0, M0, L0>& sv0, SVs&&... svs)
 {
-    return detail::apply_impl(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
 }
 
 // Apply overload 3: First parameter is const synchronized_value (const lvalue reference)
-template<typename F, typename T0, Lockable M0, SynchronisedValueLike... SVs>
-auto apply(F&& f, const synchronized_value<T0, M0>& sv0, SVs&&... svs)
+template<typename F, typename T0, Lockable M0, LayoutPolicy L0, SynchronisedValueLike... SVs>
+auto apply(F&& f, const synchronized_value<T0, M0, L0>& sv0, SVs&&... svs)
 {
-    return detail::apply_impl(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
 }
 
 // Apply overload 4: First parameter is const shared_synchronized_value (const lvalue reference)
-template<typename F, typename T0, SharedLockable M0, SynchronisedValueLike... SVs>
-auto apply(F&& f, const shared_synchronized_value<T0, M0>& sv0, SVs&&... svs)
+template<typename F, typename T0, SharedLockable M0, LayoutPolicy L0, SynchronisedValueLike... SVs>
+auto apply(F&& f, const shared_synchronized_value<T0, M0, L0>& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<default_lock_policy>(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+}
+
+// Apply overload 5: explicit lock acquisition policy, e.g. apply(BM::std_lock, f, a, b)
+template<LockPolicy Policy, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto apply(Policy, F&& f, SV0&& sv0, SVs&&... svs)
+{
+    return detail::apply_impl<Policy>(std::forward<F>(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+// Deadline-bounded apply: f runs only if all values get locked in time (or,
+// with a std::stop_token, before a stop is requested). Returns f's result as
+// std::optional (bool for void f), empty/false when it gave up - with nothing
+// left locked. Values are locked in ordered_lock_policy order.
+template<typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto try_apply(F&& f, SV0&& sv0, SVs&&... svs)
+{
+    // steady_clock's epoch has long passed: a single try_lock() per value
+    return detail::try_apply_impl({std::chrono::steady_clock::time_point{}, {}},
+                                  std::forward<F>(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+template<class Clock, class Duration, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto apply_until(std::stop_token stop, const std::chrono::time_point<Clock, Duration>& deadline,
+                 F&& f, SV0&& sv0, SVs&&... svs)
+{
+    return detail::try_apply_impl({detail::deadline::steady(deadline), std::move(stop)},
+                                  std::forward<F>(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+template<class Clock, class Duration, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto apply_until(const std::chrono::time_point<Clock, Duration>& deadline, F&& f, SV0&& sv0, SVs&&... svs)
+{
+    return apply_until(std::stop_token{}, deadline, std::forward<F>(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+template<class Rep, class Period, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto apply_for(std::stop_token stop, const std::chrono::duration<Rep, Period>& timeout,
+               F&& f, SV0&& sv0, SVs&&... svs)
+{
+    return apply_until(std::move(stop), std::chrono::steady_clock::now() + timeout,
+                       std::forward<F>(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+template<class Rep, class Period, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto apply_for(const std::chrono::duration<Rep, Period>& timeout, F&& f, SV0&& sv0, SVs&&... svs)
+{
+    return apply_for(std::stop_token{}, timeout, std::forward<F>(f), std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+// Condition wait for any mutex: blocks until pred(values...) holds, then runs
+// f(values...) under the same locks and returns what f returns.
+//   auto job = BM::apply_when([](const Queue& q) { return !q.empty(); },
+//                             [](Queue& q) { return q.pop(); }, queue);
+// Every apply() with mutable access to a value notifies its waiters. pred
+// gets const references and may be re-checked by the thread that has just
+// changed the value (with the value still locked), so it must be a plain
+// function of the values: no side effects, no locking. Of several waiters
+// for one value only the first one whose pred holds is woken up, it wakes
+// the next one when done.
+template<typename Pred, typename F, SynchronisedValueLike SV0, SynchronisedValueLike... SVs>
+auto apply_when(Pred&& pred, F&& f, SV0&& sv0, SVs&&... svs)
+{
+    static_assert((lock_excludes_writers_v<SV0> && ... && lock_excludes_writers_v<SVs>),
+                  "apply_when() needs values whose lock keeps writers out");
+    return detail::apply_when_impl(std::forward<Pred>(pred), std::forward<F>(f),
+                                   std::forward<SV0>(sv0), std::forward<SVs>(svs)...);
+}
+
+// Apply overload 6: runtime set of values, e.g. a settlement batch
+//   std::vector<synchronized_value<Account>*> accounts = ...;
+//   apply([](std::span<const std::reference_wrapper<Account>> batch) { ... }, std::span(accounts));
+// Duplicates are dropped, f gets every distinct value once, in order of first occurrence
+template<typename F, typename SVPtr, std::size_t N>
+    requires std::is_pointer_v<std::remove_const_t<SVPtr>> &&
+             is_synchronized_value_v<std::remove_pointer_t<std::remove_const_t<SVPtr>>>
+auto apply(F&& f, std::span<SVPtr, N> svs)
 {
-    return detail::apply_impl(std::forward<F>(f), sv0, std::forward<SVs>(svs)...);
+    using SV = std::remove_pointer_t<std::remove_const_t<SVPtr>>;
+    return detail::apply_span_impl(std::forward<F>(f), std::span<SV* const>(svs));
 }
 
 } // namespace BM
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "synchronized_value.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace BM {
+
+// Shared mutexes with a third, upgradable mode: one upgrader at a time, next
+// to any number of readers, which can turn its lock into an exclusive one
+// without letting another writer or upgrader in between
+template<typename Mutex>
+concept UpgradeLockable = SharedLockable<Mutex> && requires(Mutex& m) {
+    { m.lock_upgrade() } -> std::same_as<void>;
+    { m.try_lock_upgrade() } -> std::same_as<bool>;
+    { m.unlock_upgrade() } -> std::same_as<void>;
+    { m.unlock_upgrade_and_lock() } -> std::same_as<void>;
+};
+
+// Readers/upgrader/writer lock on a mutex and a condition variable.
+//
+// Waiting writers and a promoting upgrader hold off new readers and new
+// upgraders, so neither can be starved by a steady stream of readers.
+class upgrade_mutex {
+    std::mutex m;
+    std::condition_variable cv;
+    unsigned readers = 0;
+    unsigned writers_waiting = 0;
+    bool writer = false;
+    bool upgrader = false;
+    bool promoting = false;
+
+    bool can_lock() const { return !writer && !upgrader && readers == 0; }
+    bool can_lock_shared() const { return !writer && !promoting && writers_waiting == 0; }
+    bool can_lock_upgrade() const { return !writer && !upgrader && writers_waiting == 0; }
+
+public:
+    upgrade_mutex() = default;
+    upgrade_mutex(const upgrade_mutex&) = delete;
+    upgrade_mutex& operator=(const upgrade_mutex&) = delete;
+
+    // Lockable - writers
+    void lock() {
+        std::unique_lock l(m);
+        ++writers_waiting;
+        cv.wait(l, [this] { return can_lock(); });
+        --writers_waiting;
+        writer = true;
+    }
+
+    bool try_lock() {
+        std::lock_guard l(m);
+        if (!can_lock()) {
+            return false;
+        }
+        writer = true;
+        return true;
+    }
+
+    void unlock() {
+        {
+            std::lock_guard l(m);
+            writer = false;
+        }
+        cv.notify_all();
+    }
+
+    // SharedLockable - readers
+    void lock_shared() {
+        std::unique_lock l(m);
+        cv.wait(l, [this] { return can_lock_shared(); });
+        ++readers;
+    }
+
+    bool try_lock_shared() {
+        std::lock_guard l(m);
+        if (!can_lock_shared()) {
+            return false;
+        }
+        ++readers;
+        return true;
+    }
+
+    void unlock_shared() {
+        bool last;
+        {
+            std::lock_guard l(m);
+            last = --readers == 0;
+        }
+        if (last) {
+            cv.notify_all();
+        }
+    }
+
+    // UpgradeLockable - the upgrader
+    void lock_upgrade() {
+        std::unique_lock l(m);
+        cv.wait(l, [this] { return can_lock_upgrade(); });
+        upgrader = true;
+    }
+
+    bool try_lock_upgrade() {
+        std::lock_guard l(m);
+        if (!can_lock_upgrade()) {
+            return false;
+        }
+        upgrader = true;
+        return true;
+    }
+
+    void unlock_upgrade() {
+        {
+            std::lock_guard l(m);
+            upgrader = false;
+        }
+        cv.notify_all();
+    }
+
+    // Waits for the readers already in to leave, lets no one else in meanwhile
+    void unlock_upgrade_and_lock() {
+        std::unique_lock l(m);
+        promoting = true;
+        cv.wait(l, [this] { return readers == 0; });
+        promoting = false;
+        upgrader = false;
+        writer = true;
+    }
+};
+
+// What apply_upgradable() hands to its callback: const access to the value
+// until upgrade() is called, mutable access from then on
+template<typename T>
+class upgradable_access {
+    T& value;
+    void (*promote)(void*);
+    void* lock_state;
+    bool upgraded = false;
+
+    template<typename F, typename T2, UpgradeLockable M2, LayoutPolicy L2>
+    friend auto apply_upgradable(F&& f, synchronized_value<T2, M2, L2>& sv);
+
+    upgradable_access(T& value, void (*promote)(void*), void* lock_state)
+        : value(value), promote(promote), lock_state(lock_state) {}
+
+public:
+    upgradable_access(const upgradable_access&) = delete;
+    upgradable_access& operator=(const upgradable_access&) = delete;
+
+    const T& get() const { return value; }
+    const T& operator*() const { return value; }
+    const T* operator->() const { return &value; }
+
+    // Exclusive access, waiting for readers to leave first if not yet upgraded.
+    // No other writer can have run since the callback started.
+    T& upgrade() {
+        if (!upgraded) {
+            promote(lock_state);
+            upgraded = true;
+        }
+        return value;
+    }
+
+    bool is_upgraded() const { return upgraded; }
+};
+
+// Check-then-modify on a single value without taking it exclusively up front:
+//   apply_upgradable([](upgradable_access<Account>& acc) {
+//       if (acc->balance >= 1'000'000) {
+//           acc.upgrade().balance += bonus;
+//       }
+//   }, account);
+// f runs with an upgrade lock (readers still get in, other upgraders and
+// writers do not); upgrade() turns it into an exclusive lock in place.
+template<typename F, typename T, UpgradeLockable M, LayoutPolicy L>
+auto apply_upgradable(F&& f, synchronized_value<T, M, L>& sv)
+{
+    detail::defer_scope deferred;
+    detail::apply_probe probe(reinterpret_cast<std::uintptr_t>(&detail::get_mutex_ref(sv)), 1);
+
+    // Probes (BM/usdt.hpp): the upgrade lock is an acquire with shared = 1,
+    // upgrade() another one with shared = 0, waiting for readers to leave
+    struct lock_state {
+        M& m;
+        bool exclusive = false;
+
+        std::uintptr_t address() const { return reinterpret_cast<std::uintptr_t>(&m); }
+
+        explicit lock_state(M& m) : m(m) {
+            if (detail::lock_traced()) {
+                detail::traced_lock(address(), true, [&] { return m.try_lock_upgrade(); }, [&] { m.lock_upgrade(); });
+            } else {
+                m.lock_upgrade();
+            }
+            detail::single_thread::await(&m);
+        }
+
+        ~lock_state() {
+            SV_USDT_PROBE(sv, release, address(), !exclusive);
+            if (exclusive) {
+                m.unlock();
+            } else {
+                m.unlock_upgrade();
+            }
+        }
+
+        static void promote(void* self) {
+            auto& s = *static_cast<lock_state*>(self);
+            if (detail::lock_traced()) {
+                auto t0 = usdt::now_ns();
+                s.m.unlock_upgrade_and_lock();
+                SV_USDT_PROBE(sv, acquire, s.address(), usdt::now_ns() - t0, false);
+            } else {
+                s.m.unlock_upgrade_and_lock();
+            }
+            s.exclusive = true;
+        }
+    } state(detail::get_mutex_ref(sv));
+
+    upgradable_access<T> access(detail::get_value_ref(sv), &lock_state::promote, &state);
+    detail::scope_exit notify([&] {
+        if (access.is_upgraded() && detail::wait_table::has_waiters()) {
+            detail::wait_table::notify(reinterpret_cast<std::uintptr_t>(&state.m), true);
+        }
+    });
+    return std::invoke(std::forward<F>(f), access);
+}
+
+} // namespace BM
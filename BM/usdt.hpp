@@ -0,0 +1,140 @@
+#pragma once
+
+// Static tracing probes (USDT, the format of systemtap's <sys/sdt.h>) for
+// bpftrace, perf and friends to attach to a running process:
+//
+//   SV_USDT_PROBE(sv, acquire, address, wait_ns, shared);
+//
+// A probe is a single nop in the code plus an ELF note (.note.stapsdt) that
+// tells the tracer where it is and where its arguments live (registers or
+// memory, whatever the compiler picked). With no tracer attached the cost is
+// the nop and keeping the arguments around.
+//
+// Every probe also has a semaphore, a counter the tracer bumps while attached
+// (bpftrace does; perf with Linux 4.20+), declared once per probe with
+//   SV_USDT_SEMAPHORE(sv, acquire);
+// at global scope. Work done only for a probe's sake (reading the clock for a
+// wait time, taking a different locking path) goes behind
+//   if (SV_USDT_ENABLED(sv, acquire)) { ... }
+// - one load of a rarely written global when nobody is tracing.
+//
+// Probes and their arguments: see bpftrace/README.md. List them with
+//   readelf -n ./sv-bench | grep -A4 stapsdt
+//
+// Written out here rather than taken from <sys/sdt.h> to keep BM/ free of
+// build dependencies; x86-64 Linux only for now, elsewhere (or built with
+// -DSV_USDT=0) the probes compile to nothing.
+
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#ifndef SV_USDT
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+#define SV_USDT 1
+#endif
+#endif
+
+#ifndef SV_USDT
+#define SV_USDT 0
+#endif
+
+namespace BM::usdt {
+
+// Argument size as the note spells it: bytes, negative for signed types
+template<typename T>
+inline constexpr int arg_size = [] {
+    using U = std::decay_t<T>;
+    constexpr int size = std::is_pointer_v<U> ? static_cast<int>(sizeof(void*)) : static_cast<int>(sizeof(U));
+    return std::is_signed_v<U> ? -size : size;
+}();
+
+// Same clock as bpftrace's nsecs
+inline std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace BM::usdt
+
+#if SV_USDT
+
+// The note joins the section group of the function it is in ("?", GNU as
+// 2.35+), so it goes away with a discarded inline copy; plain for clang, as
+// <sys/sdt.h> does where the assembler cannot tell
+#if defined(__clang__)
+#define SV_USDT_NOTE_FLAGS_ ""
+#else
+#define SV_USDT_NOTE_FLAGS_ "?"
+#endif
+
+// "%n" prints the negated constant, hence -arg_size: "8@%rdi", "-4@%esi"
+#define SV_USDT_ARG_FORMAT_(n) "%n[sv_usdt_s" #n "]@%[sv_usdt_a" #n "]"
+#define SV_USDT_OPERAND_(n, x) \
+    [sv_usdt_s##n] "n"(-::BM::usdt::arg_size<decltype(x)>), [sv_usdt_a##n] "nor"(x)
+
+// The semaphore: an unsigned short in .probes, named as <sys/sdt.h> names
+// them; hidden, so that every binary and shared library has its own
+#define SV_USDT_SEMAPHORE(provider, name)                                                    \
+    namespace BM::usdt {                                                                     \
+    extern "C" {                                                                             \
+    [[gnu::section(".probes"), gnu::visibility("hidden"), gnu::used]]                        \
+    inline volatile unsigned short provider##_##name##_semaphore = 0;                        \
+    }                                                                                        \
+    }                                                                                        \
+    static_assert(true)
+
+#define SV_USDT_ENABLED(provider, name) \
+    (__builtin_expect(::BM::usdt::provider##_##name##_semaphore != 0, 0))
+
+// The note: probe address, base address (to find out how far the binary was
+// relocated), semaphore address, provider, name, argument locations
+#define SV_USDT_ASM_(provider, name, args, ...)                                              \
+    __asm__ __volatile__(                                                                    \
+        "990: nop\n"                                                                         \
+        ".pushsection .note.stapsdt,\"" SV_USDT_NOTE_FLAGS_ "\",\"note\"\n"                  \
+        ".balign 4\n"                                                                        \
+        ".4byte 992f-991f, 994f-993f, 3\n"                                                   \
+        "991: .asciz \"stapsdt\"\n"                                                          \
+        "992: .balign 4\n"                                                                   \
+        "993: .8byte 990b\n"                                                                 \
+        ".8byte _.stapsdt.base\n"                                                            \
+        ".8byte " #provider "_" #name "_semaphore\n"                                         \
+        ".asciz \"" #provider "\"\n"                                                         \
+        ".asciz \"" #name "\"\n"                                                             \
+        ".asciz \"" args "\"\n"                                                              \
+        "994: .balign 4\n"                                                                   \
+        ".popsection\n"                                                                      \
+        ".ifndef _.stapsdt.base\n"                                                           \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"              \
+        ".weak _.stapsdt.base\n"                                                             \
+        ".hidden _.stapsdt.base\n"                                                           \
+        "_.stapsdt.base: .space 1\n"                                                         \
+        ".size _.stapsdt.base, 1\n"                                                          \
+        ".popsection\n"                                                                      \
+        ".endif\n"                                                                           \
+        :: __VA_ARGS__)
+
+#define SV_USDT_PROBE0_(provider, name) SV_USDT_ASM_(provider, name, "", )
+#define SV_USDT_PROBE1_(provider, name, a1) \
+    SV_USDT_ASM_(provider, name, SV_USDT_ARG_FORMAT_(1), SV_USDT_OPERAND_(1, a1))
+#define SV_USDT_PROBE2_(provider, name, a1, a2)                                              \
+    SV_USDT_ASM_(provider, name, SV_USDT_ARG_FORMAT_(1) " " SV_USDT_ARG_FORMAT_(2),          \
+                 SV_USDT_OPERAND_(1, a1), SV_USDT_OPERAND_(2, a2))
+#define SV_USDT_PROBE3_(provider, name, a1, a2, a3)                                          \
+    SV_USDT_ASM_(provider, name,                                                             \
+                 SV_USDT_ARG_FORMAT_(1) " " SV_USDT_ARG_FORMAT_(2) " " SV_USDT_ARG_FORMAT_(3), \
+                 SV_USDT_OPERAND_(1, a1), SV_USDT_OPERAND_(2, a2), SV_USDT_OPERAND_(3, a3))
+
+#define SV_USDT_PICK_(_0, _1, _2, _3, macro, ...) macro
+#define SV_USDT_PROBE(provider, ...)                                                         \
+    SV_USDT_PICK_(__VA_ARGS__, SV_USDT_PROBE3_, SV_USDT_PROBE2_, SV_USDT_PROBE1_,            \
+                  SV_USDT_PROBE0_, )(provider, __VA_ARGS__)
+
+#else
+
+#define SV_USDT_SEMAPHORE(provider, name) static_assert(true)
+#define SV_USDT_ENABLED(provider, name) false
+#define SV_USDT_PROBE(provider, ...) do {} while (false)
+
+#endif
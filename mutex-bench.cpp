@@ -0,0 +1,472 @@
+// mutex-bench - raw mutex behaviour per mutex type: uncontended cost,
+// hand-off latency, convoys and fairness
+//
+// Scenarios (--scenario, all of them by default):
+//
+//   uncontended  one thread, lock()/unlock() pairs back to back; p50/p99 are
+//                per-pair averages over batches of 256
+//   pingpong     two threads take turns: the holder waits until the other one
+//                is about to call lock(), keeps holding for --hold-us (long
+//                enough for it to go to sleep), then unlocks, and calls lock()
+//                again only once the other one has the lock (no barging);
+//                p50/p99 are the unlock-to-lock hand-off latencies
+//   convoy       --threads threads, short critical sections (--cs-iters)
+//                with --think-iters of work outside the lock in between. The
+//                lock is free most of the time - unless waiters queue up and
+//                every acquisition turns into a wake-up: handoff_pct and
+//                ctx_switches_per_op going up show the convoy
+//   fairness     the same with nothing to do outside the lock; fairness is
+//                the slowest thread's share of operations over the fastest
+//                one's (1.0 = perfectly even)
+//
+// For convoy and fairness p50/p99 are lock() wait times (every 64th
+// acquisition) and handoff_pct the share of acquisitions by another thread
+// than the previous owner. ns_per_op is wall-clock time per operation, all
+// threads together.
+//
+// Each scenario runs with threads left to the scheduler and pinned, thread i
+// to the i-th CPU of the affinity mask (--pinning). Context switches and
+// cache misses per operation are counted by perf_event_open over the measured
+// threads - user and kernel if perf_event_paranoid allows it, user only
+// otherwise. Where a counter cannot be opened (no PMU in a VM, a seccomp'd
+// container) its column stays empty. One CSV row per configuration on stdout:
+//
+//   scenario,mutex,pinning,threads,ops,ns_per_op,p50_ns,p99_ns,handoff_pct,fairness,ctx_switches_per_op,cache_misses_per_op
+//
+// Usage: ./mutex-bench [--duration-ms MS] [--scenario uncontended,...]
+//                      [--mutex std::mutex,...] [--pinning unpinned,pinned]
+//                      [--threads 2,4] [--hold-us US] [--cs-iters N]
+//                      [--think-iters N]
+
+#include "ptmutex-raii.h"
+#include "BM/synchronized_value.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static_assert(BM::Lockable<PTMutexErrorChecking> && BM::Lockable<PTMutex<>>);
+
+using namespace std::chrono;
+
+struct Config {
+    milliseconds duration{500};
+    microseconds hold{5};
+    unsigned cs_iters = 50;
+    unsigned think_iters = 200;
+    std::vector<unsigned> threads = {2, 4};
+    std::vector<std::string> scenarios;   // empty = all
+    std::vector<std::string> mutexes;     // empty = all
+    std::vector<std::string> pinnings = {"unpinned", "pinned"};
+    std::vector<int> cpus;                // affinity mask, pinned threads go round-robin
+
+    static bool contains(const std::vector<std::string>& list, std::string_view name) {
+        return list.empty() || std::find(list.begin(), list.end(), name) != list.end();
+    }
+};
+
+// Context switches and cache misses of the measured threads, nullopt as soon
+// as one of them could not count
+struct Counts {
+    std::optional<std::uint64_t> context_switches = 0;
+    std::optional<std::uint64_t> cache_misses = 0;
+    std::mutex mut;
+};
+
+// perf_event_open counters of the calling thread
+class PerfCounters {
+    int context_switches;
+    int cache_misses;
+
+    static int open(std::uint32_t type, std::uint64_t config) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_hv = 1;
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+            // perf_event_paranoid >= 2: own user-space events only
+            attr.exclude_kernel = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+        return fd;
+    }
+
+    static void control(int fd, unsigned long request) {
+        if (fd >= 0) {
+            ioctl(fd, request, 0);
+        }
+    }
+
+    static void add(int fd, std::optional<std::uint64_t>& sum) {
+        std::uint64_t n = 0;
+        if (fd < 0 || read(fd, &n, sizeof(n)) != sizeof(n)) {
+            sum.reset();
+        } else if (sum) {
+            *sum += n;
+        }
+    }
+
+public:
+    PerfCounters()
+        : context_switches(open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES))
+        , cache_misses(open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES)) {}
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        for (int fd : {context_switches, cache_misses}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    void start() {
+        for (int fd : {context_switches, cache_misses}) {
+            control(fd, PERF_EVENT_IOC_RESET);
+            control(fd, PERF_EVENT_IOC_ENABLE);
+        }
+    }
+
+    void stop_into(Counts& counts) {
+        for (int fd : {context_switches, cache_misses}) {
+            control(fd, PERF_EVENT_IOC_DISABLE);
+        }
+        std::lock_guard l(counts.mut);
+        add(context_switches, counts.context_switches);
+        add(cache_misses, counts.cache_misses);
+    }
+};
+
+struct Result {
+    unsigned threads = 1;
+    std::uint64_t ops = 0;
+    double seconds = 0;
+    std::vector<std::uint64_t> samples;   // ns, for p50/p99
+    std::optional<double> handoff_pct;
+    std::optional<double> fairness;
+    Counts counts;
+};
+
+// Calling thread to the i-th allowed CPU, or left alone
+void pin(const Config& cfg, bool pinned, unsigned i) {
+    if (!pinned || cfg.cpus.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cfg.cpus[i % cfg.cpus.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Busy work the compiler cannot drop or merge
+void work(unsigned iters) {
+    for (unsigned i = 0; i < iters; ++i) {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+}
+
+std::uint64_t now_ns() {
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename Mutex>
+void uncontended(const Config& cfg, bool pinned, Result& res) {
+    constexpr unsigned batch = 256;
+    Mutex mut;
+    std::jthread([&] {
+        pin(cfg, pinned, 0);
+        PerfCounters counters;
+        counters.start();
+        auto t0 = steady_clock::now();
+        for (auto until = t0 + cfg.duration; steady_clock::now() < until;) {
+            auto b0 = now_ns();
+            for (unsigned i = 0; i < batch; ++i) {
+                mut.lock();
+                mut.unlock();
+            }
+            res.samples.push_back((now_ns() - b0) / batch);
+            res.ops += batch;
+        }
+        res.seconds = duration<double>(steady_clock::now() - t0).count();
+        counters.stop_into(res.counts);
+    });
+}
+
+template<typename Mutex>
+void pingpong(const Config& cfg, bool pinned, Result& res) {
+    Mutex mut;
+    std::atomic<bool> stop = false;
+    std::atomic<unsigned> arriving = 0;      // holder's round, once the next round's waiter is about to lock()
+    std::atomic<unsigned> taken = 1;         // last round whose lock() returned
+    std::uint64_t released = 0;              // unlock() time of the last round, guarded by mut
+    std::barrier start(3);
+    std::vector<std::uint64_t> latencies[2];
+    std::uint64_t rounds[2] = {};
+
+    // Thread `me` holds the lock in rounds me + 1, me + 3, ... and waits for
+    // it in the others; thread 0 starts out holding it. Strict turns: a thread
+    // calls lock() for its next round only once the peer has taken the lock
+    // for the current one, so a barging mutex cannot hand it straight back.
+    auto player = [&](unsigned me) {
+        pin(cfg, pinned, me);
+        PerfCounters counters;
+        if (me == 0) {
+            mut.lock();
+        }
+        start.arrive_and_wait();
+        counters.start();
+        for (unsigned r = me + 1;; r += 2) {
+            if (r > 1) {
+                while (taken.load(std::memory_order_acquire) != r - 1 && !stop.load(std::memory_order_relaxed)) {
+                    std::this_thread::yield();
+                }
+                if (taken.load(std::memory_order_acquire) != r - 1) {
+                    break;          // stopped, the peer never got round r - 1
+                }
+                arriving.store(r - 1, std::memory_order_release);
+                mut.lock();
+                auto acquired = now_ns();
+                taken.store(r, std::memory_order_release);
+                if (stop.load(std::memory_order_relaxed)) {
+                    mut.unlock();   // the other one may be on its way out already
+                    break;
+                }
+                latencies[me].push_back(acquired - released);
+                ++rounds[me];
+            }
+
+            while (arriving.load(std::memory_order_acquire) != r && !stop.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+            bool last = stop.load(std::memory_order_relaxed);
+            if (!last) {
+                auto until = steady_clock::now() + cfg.hold;
+                while (steady_clock::now() < until) {}
+            }
+            released = now_ns();
+            mut.unlock();
+            if (last) {
+                break;
+            }
+        }
+        counters.stop_into(res.counts);
+    };
+
+    std::jthread a(player, 0u), b(player, 1u);
+    start.arrive_and_wait();
+    auto t0 = steady_clock::now();
+    std::this_thread::sleep_for(cfg.duration);
+    stop = true;
+    a.join();
+    b.join();
+    res.seconds = duration<double>(steady_clock::now() - t0).count();
+    res.threads = 2;
+    res.ops = rounds[0] + rounds[1];
+    res.samples = std::move(latencies[0]);
+    res.samples.insert(res.samples.end(), latencies[1].begin(), latencies[1].end());
+    res.handoff_pct = 100.0;
+}
+
+// convoy (think_iters > 0) and fairness (think_iters == 0)
+template<typename Mutex>
+void contended(const Config& cfg, bool pinned, unsigned threads, unsigned think_iters, Result& res) {
+    constexpr unsigned sample_every = 64;
+    Mutex mut;
+    std::atomic<bool> stop = false;
+    std::barrier start(threads + 1);
+    unsigned owner = threads;   // guarded by mut
+    std::uint64_t handoffs = 0; // guarded by mut
+    std::uint64_t guarded = 0;  // guarded by mut
+    std::vector<std::uint64_t> ops(threads);
+    std::vector<std::vector<std::uint64_t>> waits(threads);
+
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([&, i] {
+                pin(cfg, pinned, i);
+                PerfCounters counters;
+                std::uint64_t n = 0;
+                start.arrive_and_wait();
+                counters.start();
+                while (!stop.load(std::memory_order_relaxed)) {
+                    bool sample = n % sample_every == 0;
+                    auto t0 = sample ? now_ns() : 0;
+                    mut.lock();
+                    auto waited = sample ? now_ns() - t0 : 0;
+                    if (owner != i) {
+                        owner = i;
+                        ++handoffs;
+                    }
+                    ++guarded;
+                    work(cfg.cs_iters);
+                    mut.unlock();
+                    if (sample) {
+                        waits[i].push_back(waited);     // outside: growing the vector is no hold time
+                    }
+                    work(think_iters);
+                    ++n;
+                }
+                counters.stop_into(res.counts);
+                ops[i] = n;
+            });
+        }
+        start.arrive_and_wait();
+        auto t0 = steady_clock::now();
+        std::this_thread::sleep_for(cfg.duration);
+        stop = true;
+        workers.clear();
+        res.seconds = duration<double>(steady_clock::now() - t0).count();
+    }
+
+    res.threads = threads;
+    for (unsigned i = 0; i < threads; ++i) {
+        res.ops += ops[i];
+        res.samples.insert(res.samples.end(), waits[i].begin(), waits[i].end());
+    }
+    if (guarded != res.ops) {
+        std::fprintf(stderr, "mutex-bench: %llu critical sections, expected %llu\n",
+                     static_cast<unsigned long long>(guarded), static_cast<unsigned long long>(res.ops));
+    }
+    auto [fewest, most] = std::minmax_element(ops.begin(), ops.end());
+    res.handoff_pct = res.ops ? 100.0 * handoffs / res.ops : 0.0;
+    res.fairness = *most ? static_cast<double>(*fewest) / *most : 0.0;
+}
+
+std::string per_op(const std::optional<std::uint64_t>& n, std::uint64_t ops) {
+    char buf[32] = "";
+    if (n && ops) {
+        std::snprintf(buf, sizeof(buf), "%.4f", static_cast<double>(*n) / ops);
+    }
+    return buf;
+}
+
+std::string optional_ratio(const std::optional<double>& v, const char* format) {
+    char buf[32] = "";
+    if (v) {
+        std::snprintf(buf, sizeof(buf), format, *v);
+    }
+    return buf;
+}
+
+void report(const char* scenario, const char* mutex, const char* pinning, Result& res) {
+    std::sort(res.samples.begin(), res.samples.end());
+    auto pct = [&](double p) -> unsigned long long {
+        return res.samples.empty()
+            ? 0
+            : res.samples[std::min(res.samples.size() - 1, static_cast<std::size_t>(p * res.samples.size()))];
+    };
+    std::printf("%s,%s,%s,%u,%llu,%.1f,%llu,%llu,%s,%s,%s,%s\n",
+                scenario, mutex, pinning, res.threads, static_cast<unsigned long long>(res.ops),
+                res.ops ? res.seconds * 1e9 / res.ops : 0.0, pct(0.50), pct(0.99),
+                optional_ratio(res.handoff_pct, "%.2f").c_str(), optional_ratio(res.fairness, "%.3f").c_str(),
+                per_op(res.counts.context_switches, res.ops).c_str(), per_op(res.counts.cache_misses, res.ops).c_str());
+    std::fflush(stdout);
+}
+
+template<typename Mutex>
+void run(const Config& cfg, const char* name) {
+    if (!Config::contains(cfg.mutexes, name)) {
+        return;
+    }
+    for (const auto& pinning : cfg.pinnings) {
+        bool pinned = pinning == "pinned";
+        if (Config::contains(cfg.scenarios, "uncontended")) {
+            Result res;
+            uncontended<Mutex>(cfg, pinned, res);
+            report("uncontended", name, pinning.c_str(), res);
+        }
+        if (Config::contains(cfg.scenarios, "pingpong")) {
+            Result res;
+            pingpong<Mutex>(cfg, pinned, res);
+            report("pingpong", name, pinning.c_str(), res);
+        }
+        for (unsigned threads : cfg.threads) {
+            if (Config::contains(cfg.scenarios, "convoy")) {
+                Result res;
+                contended<Mutex>(cfg, pinned, threads, cfg.think_iters, res);
+                report("convoy", name, pinning.c_str(), res);
+            }
+            if (Config::contains(cfg.scenarios, "fairness")) {
+                Result res;
+                contended<Mutex>(cfg, pinned, threads, 0, res);
+                report("fairness", name, pinning.c_str(), res);
+            }
+        }
+    }
+}
+
+std::vector<std::string> parse_list(std::string_view arg) {
+    std::vector<std::string> out;
+    while (!arg.empty()) {
+        auto comma = arg.find(',');
+        out.emplace_back(arg.substr(0, comma));
+        arg = comma == arg.npos ? std::string_view{} : arg.substr(comma + 1);
+    }
+    return out;
+}
+
+int main(int argc, char* argv[])
+{
+    Config cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view opt = argv[i];
+        const char* val = argv[i + 1];
+        if (opt == "--duration-ms")       cfg.duration = milliseconds(std::atoi(val));
+        else if (opt == "--hold-us")      cfg.hold = microseconds(std::atoi(val));
+        else if (opt == "--cs-iters")     cfg.cs_iters = std::max(0, std::atoi(val));
+        else if (opt == "--think-iters")  cfg.think_iters = std::max(0, std::atoi(val));
+        else if (opt == "--scenario")     cfg.scenarios = parse_list(val);
+        else if (opt == "--mutex")        cfg.mutexes = parse_list(val);
+        else if (opt == "--pinning")      cfg.pinnings = parse_list(val);
+        else if (opt == "--threads") {
+            cfg.threads.clear();
+            for (const auto& n : parse_list(val)) {
+                cfg.threads.push_back(std::max(1, std::atoi(n.c_str())));
+            }
+        } else {
+            std::fprintf(stderr, "mutex-bench: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cfg.cpus.push_back(cpu);
+            }
+        }
+    }
+
+    std::printf("scenario,mutex,pinning,threads,ops,ns_per_op,p50_ns,p99_ns,handoff_pct,fairness,ctx_switches_per_op,cache_misses_per_op\n");
+    run<std::mutex>(cfg, "std::mutex");
+    run<PTMutexBasic>(cfg, "PTMutexBasic");
+    run<PTMutex<>>(cfg, "PTMutex");   // PTMutexTimed is the same type
+    run<PTMutexErrorChecking>(cfg, "PTMutexErrorChecking");
+    run<PTMutexAdaptive>(cfg, "PTMutexAdaptive");
+    run<SpinFutexMutex>(cfg, "SpinFutexMutex");
+}
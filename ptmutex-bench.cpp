@@ -0,0 +1,239 @@
+// ptmutex-bench - lock() tail latency of a high-priority thread sharing a
+// mutex with low-priority ones, per PTMutex variant
+//
+// One high-priority thread locks the mutex every --period-us and records how
+// long lock() took. --low low-priority threads keep taking the same mutex,
+// holding it for --hold-us each time. --medium threads at a priority in
+// between wake up every --burst-period-us and spin for --burst-us without
+// ever touching the mutex. With all of them on one CPU (--cpu, -1 = no
+// pinning) this is the textbook priority inversion: a medium thread preempts
+// the low-priority owner and the high-priority thread waits for the medium
+// one's burst to end - unless the mutex boosts the owner (PrioInherit,
+// PrioProtect).
+//
+// Priorities are SCHED_FIFO 10/20/30 (main thread 30), which needs root,
+// CAP_SYS_NICE or an RLIMIT_RTPRIO of at least 30. Otherwise everything runs
+// SCHED_OTHER with nice 19/10/0 - no inversion to speak of, the "sched"
+// column says which one it was. The low threads never sleep, so with
+// SCHED_FIFO the kernel's RT throttling (sched_rt_runtime_us) stalls all of
+// them for a few dozen ms per second - that shows up in max_ns, not p99.
+// One CSV row per mutex on stdout:
+//
+//   mutex,sched,low,medium,samples,p50_ns,p99_ns,p999_ns,max_ns,low_ops_per_sec
+//
+// Usage: ./ptmutex-bench [--duration-ms MS] [--period-us US] [--hold-us US]
+//                        [--low N] [--medium N] [--burst-us US]
+//                        [--burst-period-us US] [--cpu N] [--mutex PTMutex,...]
+
+#include "ptmutex-raii.h"
+#include "BM/synchronized_value.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+static_assert(BM::Lockable<PTMutex<>> && BM::TimedLockable<PTMutex<>>);
+static_assert(BM::Lockable<PTMutexAdaptive> && BM::TimedLockable<PTMutexAdaptive>);
+static_assert(BM::Lockable<PTMutexPrioInherit> && BM::TimedLockable<PTMutexPrioInherit>);
+static_assert(BM::Lockable<PTMutexRobust> && BM::TimedLockable<PTMutexRobust>);
+static_assert(BM::TimedLockable<PTMutex<PTMutexAttr::ErrorCheck, PTMutexAttr::ProcessShared>>);
+
+using namespace std::chrono;
+
+// SCHED_FIFO priorities of the three thread classes; PrioProtect's ceiling
+// must not be below the highest of them
+enum class Level { low = 10, medium = 20, high = 30 };
+constexpr int ceiling = static_cast<int>(Level::high);
+
+struct Config {
+    milliseconds duration{1000};
+    microseconds period{200};
+    microseconds hold{20};
+    unsigned low = 2;
+    unsigned medium = 1;
+    microseconds burst{500};
+    microseconds burst_period{1000};
+    int cpu = 0;
+    std::vector<std::string> mutexes;   // empty = all
+    bool fifo = false;                  // SCHED_FIFO available
+
+    bool selected(std::string_view name) const {
+        return mutexes.empty() || std::find(mutexes.begin(), mutexes.end(), name) != mutexes.end();
+    }
+};
+
+// Calling thread to the given level (and CPU); false if SCHED_FIFO was refused
+bool enter(int cpu, Level level) {
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    sched_param param{};
+    param.sched_priority = static_cast<int>(level);
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) {
+        return true;
+    }
+    // per-thread nice value (Linux), lowering it needs no privileges
+    int nice = level == Level::low ? 19 : level == Level::medium ? 10 : 0;
+    setpriority(PRIO_PROCESS, 0, nice);
+    return false;
+}
+
+void spin_for(microseconds d) {
+    auto until = steady_clock::now() + d;
+    while (steady_clock::now() < until) {}
+}
+
+void sleep_until(steady_clock::time_point t) {
+    auto ns = duration_cast<nanoseconds>(t.time_since_epoch()).count();
+    timespec ts{static_cast<time_t>(ns / 1'000'000'000), static_cast<long>(ns % 1'000'000'000)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+template<typename Mutex>
+void run(const Config& cfg, const char* name) {
+    if (!cfg.selected(name)) {
+        return;
+    }
+    Mutex mut;
+    try {
+        // a priority ceiling the caller may not raise itself to, missing
+        // PI futex support, ... - better found out here than in a worker
+        std::lock_guard probe(mut);
+    } catch (const std::system_error& e) {
+        std::fprintf(stderr, "ptmutex-bench: %s skipped: %s\n", name, e.what());
+        return;
+    }
+
+    std::atomic<bool> stop = false;
+    std::barrier start(cfg.low + cfg.medium + 2);
+    std::vector<std::uint64_t> waits;
+    waits.reserve(static_cast<std::size_t>(cfg.duration / cfg.period) + 1);
+    std::vector<std::uint64_t> low_ops(cfg.low);
+    long guarded = 0;   // protected by mut, checked at the end
+    long high_ops = 0;
+
+    std::vector<std::jthread> threads;
+    for (unsigned i = 0; i < cfg.low; ++i) {
+        threads.emplace_back([&, i] {
+            enter(cfg.cpu, Level::low);
+            start.arrive_and_wait();
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::lock_guard l(mut);
+                ++guarded;
+                spin_for(cfg.hold);
+                ++low_ops[i];
+            }
+        });
+    }
+    for (unsigned i = 0; i < cfg.medium; ++i) {
+        threads.emplace_back([&] {
+            enter(cfg.cpu, Level::medium);
+            start.arrive_and_wait();
+            for (auto next = steady_clock::now(); !stop.load(std::memory_order_relaxed); next += cfg.burst_period) {
+                sleep_until(next);
+                spin_for(cfg.burst);
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        enter(cfg.cpu, Level::high);
+        start.arrive_and_wait();
+        for (auto next = steady_clock::now(); !stop.load(std::memory_order_relaxed); next += cfg.period) {
+            sleep_until(next);
+            auto t0 = steady_clock::now();
+            std::lock_guard l(mut);
+            auto t1 = steady_clock::now();
+            ++guarded;
+            ++high_ops;
+            waits.push_back(duration_cast<nanoseconds>(t1 - t0).count());
+        }
+    });
+
+    start.arrive_and_wait();
+    auto t0 = steady_clock::now();
+    std::this_thread::sleep_for(cfg.duration);
+    stop = true;
+    threads.clear();
+    auto elapsed = duration<double>(steady_clock::now() - t0).count();
+
+    std::uint64_t total_low = 0;
+    for (auto n : low_ops) total_low += n;
+    if (guarded != static_cast<long>(total_low) + high_ops) {
+        std::fprintf(stderr, "ptmutex-bench: %s: %ld critical sections, expected %ld\n",
+                     name, guarded, static_cast<long>(total_low) + high_ops);
+    }
+
+    std::sort(waits.begin(), waits.end());
+    auto pct = [&](double p) -> unsigned long long {
+        return waits.empty() ? 0 : waits[std::min(waits.size() - 1, static_cast<std::size_t>(p * waits.size()))];
+    };
+    std::printf("%s,%s,%u,%u,%zu,%llu,%llu,%llu,%llu,%.0f\n",
+                name, cfg.fifo ? "fifo" : "other", cfg.low, cfg.medium, waits.size(),
+                pct(0.50), pct(0.99), pct(0.999), waits.empty() ? 0ull : static_cast<unsigned long long>(waits.back()),
+                total_low / elapsed);
+    std::fflush(stdout);
+}
+
+std::vector<std::string> parse_list(std::string_view arg) {
+    std::vector<std::string> out;
+    while (!arg.empty()) {
+        auto comma = arg.find(',');
+        out.emplace_back(arg.substr(0, comma));
+        arg = comma == arg.npos ? std::string_view{} : arg.substr(comma + 1);
+    }
+    return out;
+}
+
+int main(int argc, char* argv[])
+{
+    Config cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view opt = argv[i];
+        const char* val = argv[i + 1];
+        if (opt == "--duration-ms")          cfg.duration = milliseconds(std::atoi(val));
+        else if (opt == "--period-us")       cfg.period = microseconds(std::max(1, std::atoi(val)));
+        else if (opt == "--hold-us")         cfg.hold = microseconds(std::atoi(val));
+        else if (opt == "--low")             cfg.low = std::max(0, std::atoi(val));
+        else if (opt == "--medium")          cfg.medium = std::max(0, std::atoi(val));
+        else if (opt == "--burst-us")        cfg.burst = microseconds(std::atoi(val));
+        else if (opt == "--burst-period-us") cfg.burst_period = microseconds(std::max(1, std::atoi(val)));
+        else if (opt == "--cpu")             cfg.cpu = std::atoi(val);
+        else if (opt == "--mutex")           cfg.mutexes = parse_list(val);
+        else {
+            std::fprintf(stderr, "ptmutex-bench: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // the main thread only sleeps and collects, but must not be starved by
+    // the medium spinners; it also probes every mutex, hence Level::high
+    cfg.fifo = enter(-1, Level::high);
+    if (!cfg.fifo) {
+        std::fprintf(stderr, "ptmutex-bench: no SCHED_FIFO, running SCHED_OTHER with nice values\n");
+    }
+
+    std::printf("mutex,sched,low,medium,samples,p50_ns,p99_ns,p999_ns,max_ns,low_ops_per_sec\n");
+    run<std::mutex>(cfg, "std::mutex");
+    run<PTMutex<>>(cfg, "PTMutex");
+    run<PTMutexAdaptive>(cfg, "PTMutexAdaptive");
+    run<PTMutexPrioInherit>(cfg, "PTMutexPrioInherit");
+    run<PTMutex<PTMutexAttr::Adaptive, PTMutexAttr::PrioInherit>>(cfg, "PTMutex<Adaptive,PrioInherit>");
+    run<PTMutex<PTMutexAttr::PrioProtect<ceiling>>>(cfg, "PTMutex<PrioProtect>");
+    run<PTMutexRobust>(cfg, "PTMutexRobust");
+    run<SpinFutexMutex>(cfg, "SpinFutexMutex");
+}
@@ -1,17 +1,87 @@
 #include <pthread.h>
+#include <cerrno>
+#include <ctime>
+#include "BM/usdt.hpp"
+
+SV_USDT_SEMAPHORE(ptmutex, contend);
+SV_USDT_SEMAPHORE(ptmutex, acquire);
+SV_USDT_SEMAPHORE(ptmutex, release);
+SV_USDT_SEMAPHORE(ptmutex, timeout);
+
+// pthread_mutex_*() with ptmutex:* tracing probes (BM/usdt.hpp), all with the
+// mutex address first: contend (found it locked), acquire (+ wait ns, 0 if
+// it was free), release, timeout (+ wait ns). While a tracer is attached to
+// one of the lock probes, locking tries first, so only a busy mutex pays for
+// reading the clock; otherwise it is the plain pthread call.
+inline bool ptmutex_traced() {
+    return SV_USDT_ENABLED(ptmutex, contend) || SV_USDT_ENABLED(ptmutex, acquire) ||
+           SV_USDT_ENABLED(ptmutex, timeout);
+}
+
+inline int ptmutex_lock(pthread_mutex_t* m) {
+    if (!ptmutex_traced()) {
+        return pthread_mutex_lock(m);
+    }
+    int err = pthread_mutex_trylock(m);
+    if (err == EBUSY) {
+        SV_USDT_PROBE(ptmutex, contend, m);
+        auto t0 = BM::usdt::now_ns();
+        err = pthread_mutex_lock(m);
+        if (err == 0 || err == EOWNERDEAD) {
+            SV_USDT_PROBE(ptmutex, acquire, m, BM::usdt::now_ns() - t0);
+        }
+    } else if (err == 0 || err == EOWNERDEAD) {
+        SV_USDT_PROBE(ptmutex, acquire, m, std::uint64_t{0});
+    }
+    return err;
+}
+
+inline int ptmutex_trylock(pthread_mutex_t* m) {
+    int err = pthread_mutex_trylock(m);
+    if (err == 0 || err == EOWNERDEAD) {
+        SV_USDT_PROBE(ptmutex, acquire, m, std::uint64_t{0});
+    } else if (err == EBUSY) {
+        SV_USDT_PROBE(ptmutex, contend, m);
+    }
+    return err;
+}
+
+inline int ptmutex_clocklock(pthread_mutex_t* m, clockid_t clock, const struct timespec* abs_timeout) {
+    if (!ptmutex_traced()) {
+        return pthread_mutex_clocklock(m, clock, abs_timeout);
+    }
+    int err = ptmutex_trylock(m);
+    if (err != EBUSY) {
+        return err;
+    }
+    auto t0 = BM::usdt::now_ns();
+    err = pthread_mutex_clocklock(m, clock, abs_timeout);
+    if (err == 0 || err == EOWNERDEAD) {
+        SV_USDT_PROBE(ptmutex, acquire, m, BM::usdt::now_ns() - t0);
+    } else if (err == ETIMEDOUT) {
+        SV_USDT_PROBE(ptmutex, timeout, m, BM::usdt::now_ns() - t0);
+    }
+    return err;
+}
+
+inline int ptmutex_unlock(pthread_mutex_t* m) {
+    int err = pthread_mutex_unlock(m);
+    if (err == 0) {
+        SV_USDT_PROBE(ptmutex, release, m);
+    }
+    return err;
+}
 
 struct PTMutexBasic {
     pthread_mutex_t m;
     PTMutexBasic()  { pthread_mutex_init(&m, nullptr); }
     ~PTMutexBasic() { pthread_mutex_destroy(&m); }
     // BasicLockable
-    void lock()     { pthread_mutex_lock(&m); }
-    void unlock()   { pthread_mutex_unlock(&m); }
-};
+    void lock()     { ptmutex_lock(&m); }
+    void unlock()   { ptmutex_unlock(&m); }
 
-struct PTMutex : public PTMutexBasic {
-    // Lockable
-    bool try_lock() { return pthread_mutex_trylock(&m) == 0; }
+protected:
+    explicit PTMutexBasic(const pthread_mutexattr_t* attr);
 };
 
 
@@ -46,30 +116,205 @@ struct PTMutex : public PTMutexBasic {
 
 
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <ctime>
+#include <initializer_list>
+#include <system_error>
+#include <type_traits>
+
+inline PTMutexBasic::PTMutexBasic(const pthread_mutexattr_t* attr) {
+    if (int err = pthread_mutex_init(&m, attr)) {
+        throw std::system_error(err, std::system_category(), "pthread_mutex_init");
+    }
+}
+
+// Attributes for PTMutex<Attrs...>: each sets one pthread_mutexattr_t property
+// and returns the pthread error code; what is not set keeps the glibc default
+namespace PTMutexAttr {
+    template<int Kind>
+    struct Type {
+        static int apply(pthread_mutexattr_t* a) { return pthread_mutexattr_settype(a, Kind); }
+    };
+
+    using Normal     = Type<PTHREAD_MUTEX_NORMAL>;
+    using ErrorCheck = Type<PTHREAD_MUTEX_ERRORCHECK>;
+    using Recursive  = Type<PTHREAD_MUTEX_RECURSIVE>;
+#ifdef __GLIBC__
+    // glibc: spin (a self-tuning number of times) before sleeping in the kernel
+    using Adaptive   = Type<PTHREAD_MUTEX_ADAPTIVE_NP>;
+#endif
+
+    template<int P>
+    struct Protocol {
+        static int apply(pthread_mutexattr_t* a) { return pthread_mutexattr_setprotocol(a, P); }
+    };
+
+    // The owner runs at the priority of the highest-priority waiter - no
+    // priority inversion, at the price of a syscall on every contended lock
+    using PrioInherit = Protocol<PTHREAD_PRIO_INHERIT>;
+
+    // The owner runs at (at least) Ceiling while holding the mutex; locking it
+    // from a thread with a higher SCHED_FIFO/SCHED_RR priority fails (EINVAL)
+    template<int Ceiling>
+    struct PrioProtect {
+        static int apply(pthread_mutexattr_t* a) {
+            if (int err = pthread_mutexattr_setprotocol(a, PTHREAD_PRIO_PROTECT)) {
+                return err;
+            }
+            return pthread_mutexattr_setprioceiling(a, Ceiling);
+        }
+    };
+
+    // If the owner dies, the next lock() succeeds and previous_owner_died()
+    // tells so, instead of everyone waiting forever
+    struct Robust {
+        static int apply(pthread_mutexattr_t* a) { return pthread_mutexattr_setrobust(a, PTHREAD_MUTEX_ROBUST); }
+    };
+
+    // Usable from several processes when placed in shared memory
+    struct ProcessShared {
+        static int apply(pthread_mutexattr_t* a) { return pthread_mutexattr_setpshared(a, PTHREAD_PROCESS_SHARED); }
+    };
+} // namespace PTMutexAttr
+
+// pthread mutex with the given attributes, e.g.
+//   PTMutex<>                                        - default (same as before)
+//   PTMutex<PTMutexAttr::Adaptive>                   - spins before sleeping
+//   PTMutex<PTMutexAttr::PrioInherit>                - for SCHED_FIFO threads
+//   PTMutex<PTMutexAttr::Robust, PTMutexAttr::ProcessShared>
+// Errors the default mutex never reports (EDEADLK, EPERM, EINVAL for a
+// priority ceiling, ENOTRECOVERABLE, ...) are thrown as std::system_error.
+template<class... Attrs>
+struct PTMutex : public PTMutexBasic {
+    PTMutex() : PTMutexBasic(Attributes().get()) {}
+
+    // BasicLockable
+    void lock() {
+        check(ptmutex_lock(&m), "pthread_mutex_lock");
+    }
+
+    void unlock() {
+        if constexpr (is_robust) {
+            owner_died = false;
+        }
+        if (int err = ptmutex_unlock(&m)) {
+            throw std::system_error(err, std::system_category(), "pthread_mutex_unlock");
+        }
+    }
+
+    // Lockable
+    bool try_lock() {
+        int err = ptmutex_trylock(&m);
+        if (err == EBUSY) return false;
+        check(err, "pthread_mutex_trylock");
+        return true;
+    }
 
-// C++14
-struct PTMutexTimed : public PTMutexBasic {
     // TimedLockable
+    // pthread_mutex_timedlock() takes an absolute CLOCK_REALTIME deadline and
+    // jumps with wall-clock changes, so wait on CLOCK_MONOTONIC (which is what
+    // std::chrono::steady_clock reads) with pthread_mutex_clocklock() instead
 
     template< class Rep, class Period >
     bool try_lock_for( const std::chrono::duration<Rep, Period>& timeout_duration ) {
-        using namespace std::chrono;
-        auto ns = duration_cast<nanoseconds>(timeout_duration);
-
-        struct timespec timeout{
-            .tv_sec = ns.count() / 1'000'000'000,
-            .tv_nsec = ns.count() % 1'000'000'000,
-        };
-        return pthread_mutex_timedlock(&m, &timeout) == 0;
+        return try_lock_until(std::chrono::steady_clock::now() + timeout_duration);
     }
 
     template< class Clock, class Duration >
     bool try_lock_until( const std::chrono::time_point<Clock,Duration>& timeout_time ) {
-        return try_lock_for(timeout_time - Clock::now());
+        using namespace std::chrono;
+        if constexpr (std::is_same_v<Clock, system_clock>) {
+            return clocklock(CLOCK_REALTIME, timeout_time.time_since_epoch());
+        } else if constexpr (std::is_same_v<Clock, steady_clock>) {
+            return clocklock(CLOCK_MONOTONIC, timeout_time.time_since_epoch());
+        } else {
+            // any other clock: wait for the remaining time on the steady one
+            return try_lock_for(timeout_time - Clock::now());
+        }
+    }
+
+    static constexpr bool is_robust = (std::is_same_v<Attrs, PTMutexAttr::Robust> || ...);
+
+    // May be locked from other processes too (robust ones are meant to be):
+    // a single-threaded process still has to lock it, see BM::detail::is_elidable_v
+    static constexpr bool process_shared =
+        is_robust || (std::is_same_v<Attrs, PTMutexAttr::ProcessShared> || ...);
+
+    // Robust mutexes: true while holding a lock taken after the previous owner
+    // died holding it. The mutex has been marked consistent again, the data it
+    // protects may not be - repair it before unlocking.
+    bool previous_owner_died() const requires is_robust { return owner_died; }
+
+private:
+    struct NoFlag {};
+
+    // only robust mutexes pay for the flag, the others stay pthread_mutex_t sized
+    [[no_unique_address]] std::conditional_t<is_robust, bool, NoFlag> owner_died{};
+
+    struct Attributes {
+        pthread_mutexattr_t attr;
+
+        Attributes() {
+            pthread_mutexattr_init(&attr);
+            for (int err : {0, Attrs::apply(&attr)...}) {
+                if (err) {
+                    pthread_mutexattr_destroy(&attr);
+                    throw std::system_error(err, std::system_category(), "pthread_mutexattr_t");
+                }
+            }
+        }
+
+        ~Attributes() { pthread_mutexattr_destroy(&attr); }
+
+        // no attributes - nullptr, exactly as PTMutexBasic
+        const pthread_mutexattr_t* get() const { return sizeof...(Attrs) ? &attr : nullptr; }
+    };
+
+    // With the result of a lock call that did not time out / find it busy
+    void check(int err, const char* what) {
+        if (err == EOWNERDEAD) {
+            pthread_mutex_consistent(&m);
+            if constexpr (is_robust) {
+                owner_died = true;
+            }
+        } else if (err) {
+            throw std::system_error(err, std::system_category(), what);
+        }
+    }
+
+    template< class Rep, class Period >
+    bool clocklock( clockid_t clock, const std::chrono::duration<Rep, Period>& since_epoch ) {
+        using namespace std::chrono;
+        auto ns = std::max(duration_cast<nanoseconds>(since_epoch), nanoseconds::zero());
+
+        struct timespec abs_timeout{
+            .tv_sec = static_cast<time_t>(ns.count() / 1'000'000'000),
+            .tv_nsec = static_cast<long>(ns.count() % 1'000'000'000),
+        };
+        int err = ptmutex_clocklock(&m, clock, &abs_timeout);
+        if (err == EINVAL && clock == CLOCK_MONOTONIC) {
+            // priority-inheriting mutexes only got CLOCK_MONOTONIC deadlines
+            // with glibc 2.35 on Linux 5.14 - fall back to the wall clock
+            return clocklock(CLOCK_REALTIME, system_clock::now().time_since_epoch() +
+                                                 (since_epoch - steady_clock::now().time_since_epoch()));
+        }
+        if (err == ETIMEDOUT) return false;
+        check(err, "pthread_mutex_clocklock");
+        return true;
     }
 };
 
+// Former name of the timed variant - every PTMutex<...> is TimedLockable
+using PTMutexTimed = PTMutex<>;
+
+#ifdef __GLIBC__
+using PTMutexAdaptive = PTMutex<PTMutexAttr::Adaptive>;
+#endif
+using PTMutexPrioInherit = PTMutex<PTMutexAttr::PrioInherit>;
+using PTMutexRobust = PTMutex<PTMutexAttr::Robust>;
+
 
 
 
@@ -88,7 +333,7 @@ struct PTMutexErrorCheckingBasic {
     ~PTMutexErrorCheckingBasic() { pthread_mutex_destroy(&m); }
     // BasicLockable
     void lock() {
-        int err = pthread_mutex_lock(&m);
+        int err = ptmutex_lock(&m);
         if (err == EDEADLK) {
             // Same thread trying to lock again - deadlock!
             throw std::system_error(
@@ -100,7 +345,7 @@ struct PTMutexErrorCheckingBasic {
         // Could handle other errors too
     }
     void unlock() {
-        int err = pthread_mutex_unlock(&m);
+        int err = ptmutex_unlock(&m);
         if (err == EPERM) {
             // Not the owner or not locked
             throw std::system_error(
@@ -115,7 +360,7 @@ struct PTMutexErrorCheckingBasic {
 struct PTMutexErrorChecking : public PTMutexErrorCheckingBasic {
     // Lockable
     bool try_lock() {
-        int err = pthread_mutex_trylock(&m);
+        int err = ptmutex_trylock(&m);
         if (err == 0) return true;
         if (err == EBUSY) return false;
         if (err == EDEADLK) {
@@ -128,3 +373,103 @@ struct PTMutexErrorChecking : public PTMutexErrorCheckingBasic {
         return false;
     }
 };
+
+
+
+
+
+struct PTSpinlockBasic {
+    pthread_spinlock_t s;
+    PTSpinlockBasic()  { pthread_spin_init(&s, PTHREAD_PROCESS_PRIVATE); }
+    ~PTSpinlockBasic() { pthread_spin_destroy(&s); }
+    // BasicLockable
+    void lock()     { pthread_spin_lock(&s); }
+    void unlock()   { pthread_spin_unlock(&s); }
+};
+
+struct PTSpinlock : public PTSpinlockBasic {
+    // Lockable
+    bool try_lock() { return pthread_spin_trylock(&s) == 0; }
+};
+
+
+
+
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Spin-then-park mutex: waiters first spin with exponential backoff (pause
+// hints in between), then sleep on a futex. The spin budget tunes itself per
+// mutex, much like glibc's PTHREAD_MUTEX_ADAPTIVE_NP: it follows a running
+// average of how long successful spinners had to wait, and decays whenever
+// spinning did not pay off and the waiter had to park anyway.
+struct SpinFutexMutex {
+    // 0 = unlocked, 1 = locked, 2 = locked and somebody may sleep in futex
+    std::atomic<std::uint32_t> state{0};
+    std::atomic<std::uint32_t> spins{32};
+
+    static constexpr std::uint32_t max_spins = 2000;
+    static constexpr std::uint32_t max_backoff = 64;
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    void futex_wait(std::uint32_t expected) {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+    }
+
+    void futex_wake() {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    // Lockable
+    bool try_lock() {
+        std::uint32_t c = 0;
+        return state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void lock() {
+        if (try_lock()) {
+            return;
+        }
+
+        // spin with exponential backoff, within a budget of 2x the running average
+        std::uint32_t avg = spins.load(std::memory_order_relaxed);
+        std::uint32_t budget = std::min(max_spins, 2 * avg + 16);
+        std::uint32_t spun = 0;
+        for (std::uint32_t backoff = 1; spun < budget; backoff = std::min(2 * backoff, max_backoff)) {
+            for (std::uint32_t i = 0; i < backoff; ++i) {
+                cpu_relax();
+            }
+            spun += backoff;
+            if (state.load(std::memory_order_relaxed) == 0 && try_lock()) {
+                spins.store(avg + (static_cast<int>(spun) - static_cast<int>(avg)) / 8, std::memory_order_relaxed);
+                return;
+            }
+        }
+        spins.store(avg - avg / 8, std::memory_order_relaxed);
+
+        // park: mark the mutex contended, sleep until unlock() wakes us up
+        std::uint32_t c = state.exchange(2, std::memory_order_acquire);
+        while (c != 0) {
+            futex_wait(2);
+            c = state.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    void unlock() {
+        if (state.exchange(0, std::memory_order_release) == 2) {
+            futex_wake();
+        }
+    }
+};
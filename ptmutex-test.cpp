@@ -1,8 +1,27 @@
 #include "ptmutex-raii.h"
+#include "BM/synchronized_value.hpp"
+#include "BM/flat_combining.hpp"
+#include "BM/rcu_synchronized_value.hpp"
+#include "BM/lock_stats.hpp"
+#include "BM/sharded_synchronized_value.hpp"
+#include "BM/upgrade_mutex.hpp"
+#include "BM/async_apply.hpp"
+#include "BM/synchronized_map.hpp"
+#include "BM/cas_synchronized_value.hpp"
 #include <mutex>
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+#include <utility>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 template <typename Mutex>
 std::lock_guard<Mutex> lock_it(Mutex &m)
@@ -10,6 +29,19 @@ std::lock_guard<Mutex> lock_it(Mutex &m)
     return std::lock_guard<Mutex>(m);
 }
 
+// Fire-and-forget coroutine, for async_apply()
+struct detached_task
+{
+    struct promise_type
+    {
+        detached_task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
 int main(int argc, char *argv[])
 {
     int t = argc > 1 ? atoi(argv[1]) : 0;
@@ -111,5 +143,356 @@ int main(int argc, char *argv[])
         PTMutex m;
         auto l = std::scoped_lock(m, m); // oops! m repeaded :(
     }
-}
 
+    if (14 == t)
+    {
+        // Two single-threaded processes, one value in shared memory: apply()
+        // must not skip a process-shared mutex just because each process
+        // has only one thread
+        using Counter = BM::synchronized_value<long, PTMutex<PTMutexAttr::ProcessShared>>;
+        constexpr long n = 20'000;
+        void* shm = mmap(nullptr, sizeof(Counter), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (shm == MAP_FAILED) {
+            return 1;
+        }
+        auto* counter = new (shm) Counter(0L);
+
+        auto count = [&] {
+            for (long i = 0; i < n; ++i) {
+                // read-yield-write: an unlocked increment loses updates
+                // even when the processes share a single CPU
+                apply([](long& c) {
+                    long seen = c;
+                    std::this_thread::yield();
+                    c = seen + 1;
+                }, *counter);
+            }
+        };
+        pid_t child = fork();
+        if (child == 0) {
+            count();
+            _exit(0);
+        }
+        count();
+        waitpid(child, nullptr, 0);
+
+        long total = apply([](const long& c) { return c; }, std::as_const(*counter));
+        counter->~Counter();
+        munmap(shm, sizeof(Counter));
+        if (total != 2 * n) {
+            std::fprintf(stderr, "process-shared counter: %ld, expected %ld\n", total, 2 * n);
+            return 1;
+        }
+    }
+
+    if (15 == t)
+    {
+        // BM::defer() under flat combining: f may run on another thread, what
+        // it defers must still run on the caller's, before its apply() returns
+        BM::combining_synchronized_value<long> counter{0L};
+        std::atomic<long> misplaced = 0;
+
+        std::vector<std::jthread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&] {
+                for (int round = 0; round < 20'000; ++round) {
+                    bool ran = false;
+                    auto caller = std::this_thread::get_id();
+                    apply([&](long& c) {
+                        ++c;
+                        std::this_thread::yield();  // let the others pile up and combine
+                        BM::defer([&] {
+                            ran = true;
+                            if (std::this_thread::get_id() != caller) {
+                                ++misplaced;
+                            }
+                        });
+                    }, counter);
+                    if (!ran) {
+                        ++misplaced;
+                    }
+                }
+            });
+        }
+        threads.clear();
+
+        if (misplaced != 0) {
+            std::fprintf(stderr, "deferred actions run late or on another thread: %ld\n", misplaced.load());
+            return 1;
+        }
+    }
+
+    if (16 == t)
+    {
+        // RCU: a reader keeps its snapshot while a writer publishes a new
+        // version - and the writer does not wait for the reader to leave
+        BM::rcu_synchronized_value<std::vector<int>> v(3, 1);
+        std::atomic<int> stage = 0;
+        std::atomic<bool> changed = false;
+
+        std::jthread reader([&] {
+            apply([&](const std::vector<int>& snapshot) {
+                auto before = snapshot;
+                stage = 1;
+                while (stage != 2) {
+                    std::this_thread::yield();
+                }
+                changed = snapshot != before;
+            }, std::as_const(v));
+        });
+        while (stage != 1) {
+            std::this_thread::yield();
+        }
+        apply([](std::vector<int>& x) { x.assign(100, 7); }, v);
+        stage = 2;
+        reader.join();
+
+        auto size = apply([](const std::vector<int>& x) { return x.size(); }, std::as_const(v));
+        if (changed || size != 100) {
+            std::fprintf(stderr, "rcu snapshot changed: %d, new size: %zu\n", changed.load(), size);
+            return 1;
+        }
+    }
+
+    if (17 == t)
+    {
+        // stats_mutex: counts add up over threads (also those that exited),
+        // a new mutex reusing a slot starts from zero
+        using Account = BM::synchronized_value<long, BM::stats_mutex<std::mutex>>;
+        constexpr int n = 10'000;
+        Account a(0L), b(0L);
+        {
+            Account gone(0L);
+            apply([](long& x) { ++x; }, gone);
+        }
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < 4; ++i) {
+                threads.emplace_back([&] {
+                    for (int round = 0; round < n; ++round) {
+                        apply([](long& x) { ++x; }, a);
+                        apply([](long& x, long& y) { --x; ++y; }, a, b);
+                    }
+                });
+            }
+        }
+        Account fresh(0L);
+
+        auto sa = BM::lock_stats(a);
+        auto sb = BM::lock_stats(b);
+        auto sf = BM::lock_stats(fresh);
+        // std::lock() on two mutexes: every failed try_lock() of one made it
+        // take (and give back) the other once more
+        auto taken = sa.acquisitions + sb.acquisitions - sa.failed_try_locks - sb.failed_try_locks;
+        if (taken != 12 * n || sa.applies_by_arity[1] != 4 * n || sa.applies_by_arity[2] != 4 * n ||
+            sb.applies_by_arity[2] != 4 * n || sf.acquisitions != 0) {
+            std::fprintf(stderr, "stats: %llu acquisitions, a %llu/%llu by arity, b %llu, fresh %llu\n",
+                         (unsigned long long)taken, (unsigned long long)sa.applies_by_arity[1],
+                         (unsigned long long)sa.applies_by_arity[2], (unsigned long long)sb.applies_by_arity[2],
+                         (unsigned long long)sf.acquisitions);
+            return 1;
+        }
+    }
+
+    if (18 == t)
+    {
+        // sharded value: read_exact() is the sum of all updates, and never
+        // goes backwards while they are still coming in
+        BM::sharded_synchronized_value<long> deposits(0L);
+        constexpr long n = 20'000;
+        std::atomic<bool> backwards = false;
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < 4; ++i) {
+                threads.emplace_back([&] {
+                    for (long round = 0; round < n; ++round) {
+                        deposits.update([](long& x) { ++x; });
+                    }
+                });
+            }
+            threads.emplace_back([&] {
+                long last = 0;
+                for (int round = 0; round < 1'000; ++round) {
+                    long now = deposits.read_exact();
+                    backwards = backwards || now < last;
+                    last = now;
+                }
+            });
+        }
+        long exact = deposits.read_exact();
+        long applied = apply([](long& x) { return x; }, deposits);
+        if (backwards || exact != 4 * n || applied != 4 * n) {
+            std::fprintf(stderr, "sharded: read_exact %ld, apply %ld, expected %ld\n", exact, applied, 4 * n);
+            return 1;
+        }
+    }
+
+    if (19 == t)
+    {
+        // upgrade(): no other writer gets in between the check under the
+        // upgrade lock and the write - read-yield-write loses no updates
+        BM::synchronized_value<long, BM::upgrade_mutex> counter(0L);
+        constexpr long n = 10'000;
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < 2; ++i) {
+                threads.emplace_back([&] {
+                    for (long round = 0; round < n; ++round) {
+                        BM::apply_upgradable([](BM::upgradable_access<long>& c) {
+                            long seen = *c;
+                            std::this_thread::yield();
+                            c.upgrade() = seen + 1;
+                        }, counter);
+                    }
+                });
+                threads.emplace_back([&] {
+                    for (long round = 0; round < n; ++round) {
+                        apply([](long& c) { ++c; }, counter);
+                    }
+                });
+            }
+        }
+        long total = apply([](const long& c) { return c; }, std::as_const(counter));
+        if (total != 4 * n) {
+            std::fprintf(stderr, "upgradable counter: %ld, expected %ld\n", total, 4 * n);
+            return 1;
+        }
+    }
+
+    if (20 == t)
+    {
+        // async_apply(): every co_await completes with f's result, also
+        // those suspended on values held by a blocking apply()
+        using Account = BM::synchronized_value<long, BM::async_mutex<>>;
+        Account a(0L), b(0L);
+        constexpr int coroutines = 16, n = 1'000;
+        std::atomic<int> finished = 0;
+        std::atomic<long> results = 0;
+        {
+            BM::thread_pool pool(2);
+            auto transfers = [&](BM::thread_pool& pool) -> detached_task {
+                for (int round = 0; round < n; ++round) {
+                    long to = co_await BM::async_apply(pool, [](long& x, long& y) { --x; return ++y; }, a, b);
+                    results += to != 0;
+                }
+                ++finished;
+            };
+            std::jthread blocker([&] {
+                for (int round = 0; round < coroutines * n; ++round) {
+                    apply([](long& x, long& y) {
+                        ++x;
+                        --y;
+                        std::this_thread::yield();
+                    }, b, a);
+                }
+            });
+            for (int i = 0; i < coroutines; ++i) {
+                transfers(pool);
+            }
+            while (finished != coroutines) {
+                std::this_thread::yield();
+            }
+        }
+        long sum = apply([](long& x, long& y) { return x + y; }, a, b);
+        if (results != coroutines * n || sum != 0) {
+            std::fprintf(stderr, "async_apply: %ld results of %d, a + b = %ld\n", results.load(), coroutines * n, sum);
+            return 1;
+        }
+    }
+
+    if (21 == t)
+    {
+        // synchronized_map::apply() on the same two keys from opposite
+        // orders: no deadlock, and no update lost
+        BM::synchronized_map<std::string, long> accounts;
+        accounts.try_emplace("alice", 1'000L);
+        accounts.try_emplace("bob", 1'000L);
+        constexpr int n = 20'000;
+        {
+            std::jthread ab([&] {
+                for (int round = 0; round < n; ++round) {
+                    accounts.apply([](long& from, long& to) {
+                        --from;
+                        std::this_thread::yield();
+                        ++to;
+                    }, "alice", "bob");
+                }
+            });
+            std::jthread ba([&] {
+                for (int round = 0; round < n; ++round) {
+                    accounts.apply([](long& from, long& to) {
+                        --from;
+                        std::this_thread::yield();
+                        ++to;
+                    }, "bob", "alice");
+                }
+            });
+        }
+        auto sum = accounts.apply([](long& x, long& y) { return x + y; }, "alice", "bob");
+        if (!sum || *sum != 2'000) {
+            std::fprintf(stderr, "synchronized_map: alice + bob = %ld\n", sum ? *sum : -1L);
+            return 1;
+        }
+    }
+
+    if (22 == t)
+    {
+        // apply_when(): a waiter whose predicate does not hold yet sleeps,
+        // and wakes up when a writer's apply() makes it hold
+        using namespace std::chrono_literals;
+        BM::synchronized_value<long> balance(0L);
+        std::atomic<bool> withdrawn = false;
+
+        std::thread waiter([&] {
+            BM::apply_when([](const long& b) { return b >= 50; }, [](long& b) { b -= 50; }, balance);
+            withdrawn = true;
+        });
+        std::this_thread::sleep_for(50ms);
+        bool early = withdrawn;
+        apply([](long& b) { b += 50; }, balance);
+        for (int i = 0; i < 500 && !withdrawn; ++i) {
+            std::this_thread::sleep_for(10ms);
+        }
+        if (early || !withdrawn) {
+            std::fprintf(stderr, "apply_when: %s\n", early ? "ran before the deposit" : "not woken by the deposit");
+            _exit(1);   // the waiter may never return
+        }
+        waiter.join();
+        if (apply([](const long& b) { return b; }, std::as_const(balance)) != 0) {
+            std::fprintf(stderr, "apply_when: balance not withdrawn\n");
+            return 1;
+        }
+    }
+
+    if (23 == t)
+    {
+        // cas_synchronized_value: lock-free single-value apply() next to
+        // multi-value ones locking it, nothing lost
+        static_assert(BM::is_cas_applicable_v<int>);
+        BM::cas_synchronized_value<int> counter(0);
+        BM::synchronized_value<long> moved(0L);
+        constexpr int n = 20'000;
+        {
+            std::vector<std::jthread> threads;
+            for (int i = 0; i < 4; ++i) {
+                threads.emplace_back([&] {
+                    for (int round = 0; round < n; ++round) {
+                        apply([](int& c) {
+                            int seen = c;
+                            std::this_thread::yield();
+                            c = seen + 1;
+                        }, counter);
+                        if (round % 4 == 0) {
+                            apply([](int& c, long& m) { --c; ++m; }, counter, moved);
+                        }
+                    }
+                });
+            }
+        }
+        long total = apply([](int& c, long& m) { return c + m; }, counter, moved);
+        if (total != 4 * n) {
+            std::fprintf(stderr, "cas counter + moved: %ld, expected %d\n", total, 4 * n);
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,525 @@
+// sv-bench - throughput and latency of apply() on synchronized values
+//
+// Every configuration is run for a fixed wall-clock time and reported as one
+// CSV row on stdout (progress and sanity-check failures go to stderr):
+//
+//   impl,mutex,layout,value_bytes,sv_bytes,policy,access,arity,read_pct,threads,ops,ops_per_sec,p50_ns,p99_ns,p999_ns,fairness
+//
+// impl     - "bm" (BM::synchronized_value) or "std" (std::experimental, USE_BM_SV=0)
+// layout   - BM::layout policy of the values (compact, padded, split)
+// value_bytes - sizeof the protected value (8 = just the balance, 256 = balance + payload)
+// sv_bytes - sizeof one synchronized value (value + mutex + padding), i.e. the
+//            memory --values N of them take
+// policy   - lock policy (ordered, std); for bulk transfers "span" (one apply()
+//            over a runtime span of values) or "pairwise" (one apply() per target)
+// access   - which values an operation picks: "random" (any of --values), or
+//            "own" - thread t always the same ones, t * arity and on, right
+//            next to those of threads t - 1 and t + 1: no two threads share a
+//            value, only (depending on the layout) cache lines, so this is the
+//            false-sharing test for the layouts
+// arity    - number of values passed to a single apply() (1 = deposit/read,
+//            more = transfer from the first value to the others / sum of all)
+// read_pct - share of operations that only read (const apply, or share() when
+//            the mutex is SharedLockable; lock-free for BM::seqlock)
+// fairness - operations of the slowest thread / those of the fastest one
+//            (1 = every thread got the same share, 0 = some thread starved)
+//
+// Usage: ./sv-bench [--threads N] [--duration-ms MS] [--values N]
+//                   [--arity 1,2,3,8] [--reads 0,50,90,99]
+//                   [--mutex std::mutex,...] [--policy ordered,std]
+//                   [--layout compact,padded,split] [--value-bytes 8,256]
+//                   [--access random,own] [--bulk 4,16,32]
+
+#include "ptmutex-raii.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef USE_BM_SV
+#define USE_BM_SV 1
+#endif
+
+#if USE_BM_SV
+    #include "BM/synchronized_value.hpp"
+    #include "BM/seqlock.hpp"
+    #include "BM/flat_combining.hpp"
+    #include "BM/bravo_mutex.hpp"
+    #include "BM/parking_lot.hpp"
+    #include "BM/cohort_mutex.hpp"
+    #include "BM/mcs_mutex.hpp"
+    template<typename T, typename Mutex, typename Layout>
+    using synchronized_value = BM::synchronized_value<T, Mutex, Layout>;
+    using default_layout = BM::layout::compact;
+    constexpr const char* impl_name = "bm";
+#else
+    #include <experimental/synchronized_value>
+    template<typename T, typename Mutex, typename Layout>
+    using synchronized_value = std::experimental::synchronized_value<T>;
+    using default_layout = void;
+    constexpr const char* impl_name = "std";
+#endif
+
+template<std::size_t Bytes>
+struct FinancialData
+{
+    long balance = 0;
+    std::array<char, Bytes - sizeof(long)> payload{};
+};
+
+template<>
+struct FinancialData<sizeof(long)>
+{
+    long balance = 0;
+};
+
+// Log-linear latency histogram: 16 sub-buckets per power of two (~6% error)
+class Histogram {
+    static constexpr int sub_bits = 4;
+    static constexpr int sub_count = 1 << sub_bits;
+    std::array<std::uint64_t, 64 * sub_count> buckets{};
+
+    static std::size_t index(std::uint64_t ns) {
+        if (ns < sub_count) {
+            return ns;
+        }
+        int msb = std::bit_width(ns) - 1;
+        auto sub = (ns >> (msb - sub_bits)) & (sub_count - 1);
+        return (msb - sub_bits + 1) * sub_count + sub;
+    }
+
+    static std::uint64_t value(std::size_t idx) {
+        if (idx < sub_count) {
+            return idx;
+        }
+        int msb = idx / sub_count + sub_bits - 1;
+        auto sub = idx % sub_count;
+        return (std::uint64_t{1} << msb) | (sub << (msb - sub_bits));
+    }
+
+public:
+    void record(std::uint64_t ns) { ++buckets[index(ns)]; }
+
+    Histogram& operator+=(const Histogram& other) {
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        return *this;
+    }
+
+    std::uint64_t count() const {
+        std::uint64_t n = 0;
+        for (auto b : buckets) n += b;
+        return n;
+    }
+
+    std::uint64_t percentile(double p) const {
+        auto rank = static_cast<std::uint64_t>(p * count());
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets.size(); ++i) {
+            seen += buckets[i];
+            if (seen > rank) {
+                return value(i);
+            }
+        }
+        return 0;
+    }
+};
+
+struct Config {
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::chrono::milliseconds duration{200};
+    std::size_t values = 64;
+    std::vector<int> arities = {1, 2, 3, 8};
+    std::vector<int> read_pcts = {0, 50, 90, 99};
+    std::vector<std::string> mutexes;   // empty = all
+    std::vector<std::string> policies;  // empty = all
+    std::vector<std::string> layouts = {"compact"};
+    std::vector<int> value_bytes = {8};
+    std::vector<std::string> accesses = {"random"};
+    std::vector<int> bulk_sizes = {4, 16, 32};   // bulk transfer batch sizes
+
+    // 1, 2, 4, ... up to max_threads, then 2x oversubscription
+    std::vector<unsigned> thread_counts() const {
+        std::vector<unsigned> counts;
+        for (unsigned t = 1; t < max_threads; t *= 2) counts.push_back(t);
+        counts.push_back(max_threads);
+        counts.push_back(2 * max_threads);
+        return counts;
+    }
+
+    static bool selected(const std::vector<std::string>& filter, std::string_view name) {
+        return filter.empty() || std::find(filter.begin(), filter.end(), name) != filter.end();
+    }
+};
+
+struct Rng {
+    std::uint64_t state;
+    std::size_t own = npos;     // access "own": this thread's index
+    static constexpr std::size_t npos = std::size_t(-1);
+
+    std::uint64_t operator()() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+template<std::size_t Arity>
+std::array<std::size_t, Arity> pick_distinct(Rng& rng, std::size_t n) {
+    std::array<std::size_t, Arity> idx{};
+    if (rng.own != Rng::npos) {
+        for (std::size_t i = 0; i < Arity; ++i) {
+            idx[i] = (rng.own * Arity + i) % n;
+        }
+        return idx;
+    }
+    for (std::size_t i = 0; i < Arity; ++i) {
+        do {
+            idx[i] = rng() % n;
+        } while (std::find(idx.begin(), idx.begin() + i, idx[i]) != idx.begin() + i);
+    }
+    return idx;
+}
+
+template<typename SV, typename... Policy, std::size_t... I>
+long read_op(SV* values, const std::array<std::size_t, sizeof...(I)>& idx, std::index_sequence<I...>) {
+    auto sum = [](const auto&... data) { return (data.balance + ...); };
+#if USE_BM_SV
+    if constexpr (BM::SharedLockable<typename SV::mutex_type>) {
+        return apply(Policy{}..., sum, values[idx[I]].share()...);
+    } else {
+        return apply(Policy{}..., sum, std::as_const(values[idx[I]])...);
+    }
+#else
+    return apply(sum, values[idx[I]]...);
+#endif
+}
+
+template<typename SV, typename... Policy, std::size_t... I>
+void write_op(SV* values, const std::array<std::size_t, sizeof...(I)>& idx, std::index_sequence<I...>) {
+    auto transfer = [](auto& from, auto&... to) {
+        if constexpr (sizeof...(to) == 0) {
+            from.balance += 1;
+        } else {
+            from.balance -= sizeof...(to);
+            ((to.balance += 1), ...);
+        }
+    };
+    apply(Policy{}..., transfer, values[idx[I]]...);
+}
+
+// Names of the current configuration, as printed in the CSV row
+struct Case {
+    const char* mutex;
+    const char* layout;
+    std::size_t value_bytes;
+    std::size_t sv_bytes;
+    const char* policy;
+    const char* access = "random";
+};
+
+// Type-erased benchmark body, so that only the operations themselves are
+// instantiated for every mutex/layout/size/arity/policy combination
+struct Workload {
+    std::size_t arity;
+    void* values;
+    bool (*op)(void* values, std::size_t n, std::size_t arity, Rng& rng, int read_pct);  // true = write
+    long (*sum)(void* values, std::size_t n);
+};
+
+// Policy... is empty (plain apply) or a single BM lock policy
+template<typename SV, std::size_t Arity, typename... Policy>
+bool op(void* values, std::size_t n, std::size_t, Rng& rng, int read_pct) {
+    auto idx = pick_distinct<Arity>(rng, n);
+    if (static_cast<int>(rng() % 100) < read_pct) {
+        read_op<SV, Policy...>(static_cast<SV*>(values), idx, std::make_index_sequence<Arity>{});
+        return false;
+    }
+    write_op<SV, Policy...>(static_cast<SV*>(values), idx, std::make_index_sequence<Arity>{});
+    return true;
+}
+
+template<typename SV>
+long sum(void* values, std::size_t n) {
+    long total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        total += apply([](const auto& data) { return data.balance; }, static_cast<SV*>(values)[i]);
+    }
+    return total;
+}
+
+#if USE_BM_SV
+// Bulk transfer (settlement batch): the first of `arity` distinct values pays
+// one to each of the others, either in a single apply() over a span of all of
+// them, or pairwise - one apply() per target, re-locking the payer every time
+template<typename SV>
+std::vector<SV*> pick_batch(SV* values, std::size_t n, std::size_t arity, Rng& rng) {
+    std::vector<SV*> batch;
+    if (rng.own != Rng::npos) {
+        for (std::size_t i = 0; i < arity; ++i) {
+            batch.push_back(&values[(rng.own * arity + i) % n]);
+        }
+        return batch;
+    }
+    while (batch.size() < arity) {
+        SV* sv = &values[rng() % n];
+        if (std::find(batch.begin(), batch.end(), sv) == batch.end()) {
+            batch.push_back(sv);
+        }
+    }
+    return batch;
+}
+
+template<typename SV>
+bool bulk_span_op(void* values, std::size_t n, std::size_t arity, Rng& rng, int) {
+    auto batch = pick_batch(static_cast<SV*>(values), n, arity, rng);
+    apply([](auto accounts) {
+        accounts[0].get().balance -= static_cast<long>(accounts.size() - 1);
+        for (auto& to : accounts.subspan(1)) {
+            to.get().balance += 1;
+        }
+    }, std::span(batch));
+    return true;
+}
+
+template<typename SV>
+bool bulk_pairwise_op(void* values, std::size_t n, std::size_t arity, Rng& rng, int) {
+    auto batch = pick_batch(static_cast<SV*>(values), n, arity, rng);
+    for (std::size_t i = 1; i < batch.size(); ++i) {
+        apply([](auto& from, auto& to) {
+            from.balance -= 1;
+            to.balance += 1;
+        }, *batch[0], *batch[i]);
+    }
+    return true;
+}
+#endif
+
+void run(const Config& cfg, const Case& c, const Workload& w, int read_pct, unsigned threads) {
+    std::atomic<bool> stop = false;
+    std::barrier start(threads + 1);
+    std::vector<Histogram> histograms(threads);
+    std::vector<std::uint64_t> ops(threads), writes(threads);
+
+    std::vector<std::jthread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            Rng rng{0x9E3779B97F4A7C15ull * (t + 1)};
+            if (std::string_view(c.access) == "own") {
+                rng.own = t;
+            }
+            Histogram& hist = histograms[t];
+            start.arrive_and_wait();
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto t0 = std::chrono::steady_clock::now();
+                bool wrote = w.op(w.values, cfg.values, w.arity, rng, read_pct);
+                auto t1 = std::chrono::steady_clock::now();
+                hist.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+                writes[t] += wrote;
+                ++ops[t];
+            }
+        });
+    }
+
+    start.arrive_and_wait();
+    auto t0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(cfg.duration);
+    stop = true;
+    workers.clear();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    Histogram total;
+    std::uint64_t total_ops = 0, total_writes = 0;
+    for (unsigned t = 0; t < threads; ++t) {
+        total += histograms[t];
+        total_ops += ops[t];
+        total_writes += writes[t];
+    }
+
+    // transfers preserve the sum, deposits add one each
+    long sum = w.sum(w.values, cfg.values);
+    long expected = w.arity == 1 ? static_cast<long>(total_writes) : 0;
+    if (sum != expected) {
+        std::fprintf(stderr, "sv-bench: %s/%s/%s arity %zu: balance sum %ld, expected %ld\n",
+                     c.mutex, c.layout, c.policy, w.arity, sum, expected);
+    }
+
+    auto [min_ops, max_ops] = std::minmax_element(ops.begin(), ops.end());
+    double fairness = *max_ops ? static_cast<double>(*min_ops) / *max_ops : 1.0;
+
+    std::printf("%s,%s,%s,%zu,%zu,%s,%s,%zu,%d,%u,%llu,%.0f,%llu,%llu,%llu,%.2f\n",
+                impl_name, c.mutex, c.layout, c.value_bytes, c.sv_bytes, c.policy, c.access, w.arity, read_pct, threads,
+                static_cast<unsigned long long>(total_ops), total_ops / elapsed,
+                static_cast<unsigned long long>(total.percentile(0.50)),
+                static_cast<unsigned long long>(total.percentile(0.99)),
+                static_cast<unsigned long long>(total.percentile(0.999)), fairness);
+    std::fflush(stdout);
+}
+
+// Fresh values for every run, so that the balance check is exact
+template<typename SV, std::size_t Arity, typename... Policy>
+void run(const Config& cfg, const Case& c, int read_pct, unsigned threads) {
+    auto values = std::make_unique<SV[]>(cfg.values);
+    run(cfg, c, {Arity, values.get(), &op<SV, Arity, Policy...>, &sum<SV>}, read_pct, threads);
+}
+
+template<typename SV, std::size_t Arity>
+void run_policies(const Config& cfg, Case c) {
+    if (std::find(cfg.arities.begin(), cfg.arities.end(), static_cast<int>(Arity)) == cfg.arities.end()) {
+        return;
+    }
+    for (const auto& access : cfg.accesses) {
+        c.access = access.c_str();
+        for (unsigned threads : cfg.thread_counts()) {
+            for (int read_pct : cfg.read_pcts) {
+#if USE_BM_SV
+                if (Config::selected(cfg.policies, c.policy = "ordered")) {
+                    run<SV, Arity, BM::ordered_lock_policy>(cfg, c, read_pct, threads);
+                }
+                // policy comparison on the main matrix only (see run_arities)
+                if constexpr (std::is_same_v<typename SV::layout_type, default_layout> &&
+                              sizeof(typename SV::value_type) == sizeof(long)) {
+                    if (Config::selected(cfg.policies, c.policy = "std")) {
+                        run<SV, Arity, BM::std_lock_policy>(cfg, c, read_pct, threads);
+                    }
+                }
+#else
+                c.policy = "std";
+                run<SV, Arity>(cfg, c, read_pct, threads);
+#endif
+            }
+        }
+    }
+}
+
+#if USE_BM_SV
+template<typename SV>
+void run_bulk(const Config& cfg, Case c) {
+    for (int size : cfg.bulk_sizes) {
+        auto arity = static_cast<std::size_t>(std::clamp(size, 2, static_cast<int>(cfg.values)));
+        for (const auto& access : cfg.accesses) {
+            c.access = access.c_str();
+            for (unsigned threads : cfg.thread_counts()) {
+                for (auto [policy, op] : {std::pair{"span", &bulk_span_op<SV>}, std::pair{"pairwise", &bulk_pairwise_op<SV>}}) {
+                    if (Config::selected(cfg.policies, c.policy = policy)) {
+                        auto values = std::make_unique<SV[]>(cfg.values);
+                        run(cfg, c, {arity, values.get(), op, &sum<SV>}, 0, threads);
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+
+// Only the compact layout with 8-byte values runs the full arity matrix, the
+// layout study (other layouts, 256-byte values) is limited to 1- and 2-value
+// applies to keep the number of instantiations (and build time) in check
+template<typename Mutex, typename Layout, std::size_t Bytes>
+void run_arities(const Config& cfg, Case c) {
+    if (!Config::selected(cfg.layouts, c.layout) ||
+        std::find(cfg.value_bytes.begin(), cfg.value_bytes.end(), static_cast<int>(Bytes)) == cfg.value_bytes.end()) {
+        return;
+    }
+    using SV = synchronized_value<FinancialData<Bytes>, Mutex, Layout>;
+    c.value_bytes = sizeof(FinancialData<Bytes>);
+    c.sv_bytes = sizeof(SV);
+    run_policies<SV, 1>(cfg, c);
+    run_policies<SV, 2>(cfg, c);
+    if constexpr (Bytes == sizeof(long) && std::is_same_v<Layout, default_layout>) {
+        run_policies<SV, 3>(cfg, c);
+        run_policies<SV, 8>(cfg, c);
+#if USE_BM_SV
+        run_bulk<SV>(cfg, c);
+#endif
+    }
+}
+
+template<typename Mutex>
+void run_mutex(const Config& cfg, const char* mutex_name) {
+    if (!Config::selected(cfg.mutexes, mutex_name)) {
+        return;
+    }
+    std::fprintf(stderr, "sv-bench: %s\n", mutex_name);
+    run_arities<Mutex, default_layout, 8>(cfg, {mutex_name, "compact", 0, 0, ""});
+#if USE_BM_SV
+    run_arities<Mutex, default_layout, 256>(cfg, {mutex_name, "compact", 0, 0, ""});
+    run_arities<Mutex, BM::layout::padded, 8>(cfg, {mutex_name, "padded", 0, 0, ""});
+    run_arities<Mutex, BM::layout::padded, 256>(cfg, {mutex_name, "padded", 0, 0, ""});
+    run_arities<Mutex, BM::layout::split, 8>(cfg, {mutex_name, "split", 0, 0, ""});
+    run_arities<Mutex, BM::layout::split, 256>(cfg, {mutex_name, "split", 0, 0, ""});
+#endif
+}
+
+template<typename T>
+std::vector<T> parse_list(std::string_view arg) {
+    std::vector<T> out;
+    while (!arg.empty()) {
+        auto comma = arg.find(',');
+        std::string item(arg.substr(0, comma));
+        if constexpr (std::is_same_v<T, int>) {
+            out.push_back(std::atoi(item.c_str()));
+        } else {
+            out.push_back(item);
+        }
+        arg = comma == arg.npos ? std::string_view{} : arg.substr(comma + 1);
+    }
+    return out;
+}
+
+int main(int argc, char* argv[])
+{
+    Config cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view opt = argv[i];
+        const char* val = argv[i + 1];
+        if (opt == "--threads")          cfg.max_threads = std::max(1, std::atoi(val));
+        else if (opt == "--duration-ms") cfg.duration = std::chrono::milliseconds(std::atoi(val));
+        else if (opt == "--values")      cfg.values = std::max(16, std::atoi(val));
+        else if (opt == "--arity")       cfg.arities = parse_list<int>(val);
+        else if (opt == "--reads")       cfg.read_pcts = parse_list<int>(val);
+        else if (opt == "--mutex")       cfg.mutexes = parse_list<std::string>(val);
+        else if (opt == "--policy")      cfg.policies = parse_list<std::string>(val);
+        else if (opt == "--layout")      cfg.layouts = parse_list<std::string>(val);
+        else if (opt == "--value-bytes") cfg.value_bytes = parse_list<int>(val);
+        else if (opt == "--access")      cfg.accesses = parse_list<std::string>(val);
+        else if (opt == "--bulk")        cfg.bulk_sizes = parse_list<int>(val);
+        else {
+            std::fprintf(stderr, "sv-bench: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::printf("impl,mutex,layout,value_bytes,sv_bytes,policy,access,arity,read_pct,threads,ops,ops_per_sec,p50_ns,p99_ns,p999_ns,fairness\n");
+    run_mutex<std::mutex>(cfg, "std::mutex");
+#if USE_BM_SV
+    run_mutex<std::shared_mutex>(cfg, "std::shared_mutex");
+    run_mutex<BM::bravo_mutex<>>(cfg, "BM::bravo_mutex");
+    run_mutex<PTMutex<>>(cfg, "PTMutex");
+    run_mutex<PTMutexAdaptive>(cfg, "PTMutexAdaptive");
+    run_mutex<PTMutexErrorChecking>(cfg, "PTMutexErrorChecking");
+    run_mutex<PTSpinlock>(cfg, "PTSpinlock");
+    run_mutex<SpinFutexMutex>(cfg, "SpinFutexMutex");
+    run_mutex<BM::parking_lot_mutex<>>(cfg, "BM::parking_lot_mutex");
+    run_mutex<BM::cohort_mutex<>>(cfg, "BM::cohort_mutex");
+    run_mutex<BM::mcs_mutex<>>(cfg, "BM::mcs_mutex");
+    run_mutex<BM::seqlock<>>(cfg, "BM::seqlock");
+    run_mutex<BM::flat_combining_mutex<>>(cfg, "BM::flat_combining_mutex");
+#endif
+}